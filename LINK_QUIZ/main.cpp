@@ -3,8 +3,39 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <chrono>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <limits>
+#include <cstdint>
+#include <climits>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <functional>
+#include <tuple>
+#include <utility>
+#include <random>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <fstream>
+#include <iterator>
+#include <winsock2.h>
 #include <mysql.h>
 #include <conio.h>
+#include <io.h>
+#include <share.h>
 
 using namespace std;
 
@@ -34,6 +65,387 @@ string getHiddenInput(const string& prompt) {
     return input;
 }
 
+// Memory accounting, switched on by --memory-stats. Every operator new goes
+// through the replacements below; with accounting off they are malloc and
+// free behind one flag check. With it on, allocations, bytes and live bytes
+// are counted against the tag the allocating thread has set with
+// MemoryTagScope, and each block's size and tag are kept in a side table so
+// that it is released against the tag it was counted under, whichever
+// thread frees it. MySQL result sets are allocated by the client library,
+// so trackResult() and freeResult() count them from their row count and
+// column widths instead. Accounting is switched on once, before any other
+// thread starts, and never off; blocks allocated earlier are never counted.
+enum MemoryTag { TagOther, TagCatalog, TagQueries, TagResults, TagSessions, MemoryTagCount };
+const char* const memoryTagNames[MemoryTagCount] = {"other", "catalog", "query building", "results", "sessions"};
+
+struct MemoryCounters {
+    atomic<long long> allocations;
+    atomic<long long> bytes;      // allocated in total
+    atomic<long long> liveBytes;
+    atomic<long long> peakBytes;  // highest liveBytes seen
+};
+
+atomic<bool> memoryAccounting(false);
+MemoryCounters memoryCounters[MemoryTagCount];
+thread_local MemoryTag currentMemoryTag = TagOther;
+
+void countAllocation(MemoryTag tag, long long size) {
+    MemoryCounters& counters = memoryCounters[tag];
+    counters.allocations.fetch_add(1, memory_order_relaxed);
+    counters.bytes.fetch_add(size, memory_order_relaxed);
+    long long live = counters.liveBytes.fetch_add(size, memory_order_relaxed) + size;
+    long long peak = counters.peakBytes.load(memory_order_relaxed);
+    while (live > peak && !counters.peakBytes.compare_exchange_weak(peak, live, memory_order_relaxed)) {
+    }
+}
+
+void countRelease(MemoryTag tag, long long size) {
+    memoryCounters[tag].liveBytes.fetch_sub(size, memory_order_relaxed);
+}
+
+// Charges this thread's allocations to tag until the scope ends
+class MemoryTagScope {
+private:
+    MemoryTag previous;
+
+public:
+    explicit MemoryTagScope(MemoryTag tag) : previous(currentMemoryTag) { currentMemoryTag = tag; }
+    ~MemoryTagScope() { currentMemoryTag = previous; }
+    MemoryTagScope(const MemoryTagScope&) = delete;
+    MemoryTagScope& operator=(const MemoryTagScope&) = delete;
+};
+
+// Allocates with malloc, for the accounting's own tables, which must not
+// go through the operator new they count
+template <typename T>
+struct UntrackedAllocator {
+    typedef T value_type;
+
+    UntrackedAllocator() {}
+    template <typename U>
+    UntrackedAllocator(const UntrackedAllocator<U>&) {}
+
+    T* allocate(size_t count) {
+        if (count > SIZE_MAX / sizeof(T)) throw bad_alloc();
+        void* memory = malloc(count * sizeof(T));
+        if (!memory) throw bad_alloc();
+        return static_cast<T*>(memory);
+    }
+    void deallocate(T* pointer, size_t) { free(pointer); }
+};
+
+template <typename T, typename U>
+bool operator==(const UntrackedAllocator<T>&, const UntrackedAllocator<U>&) { return true; }
+template <typename T, typename U>
+bool operator!=(const UntrackedAllocator<T>&, const UntrackedAllocator<U>&) { return false; }
+
+struct TrackedBlock {
+    size_t size;
+    MemoryTag tag;
+};
+
+// Blocks counted while accounting is on, split by address to spread the
+// locking
+struct TrackedBlockShard {
+    mutex blocksMutex;
+    unordered_map<void*, TrackedBlock, hash<void*>, equal_to<void*>,
+                  UntrackedAllocator<pair<void* const, TrackedBlock>>> blocks;
+};
+const size_t trackedBlockShardCount = 16;
+
+// Never destroyed, since blocks are still freed during static destruction
+TrackedBlockShard& trackedBlockShard(void* block) {
+    static TrackedBlockShard* shards = [] {
+        void* memory = malloc(sizeof(TrackedBlockShard) * trackedBlockShardCount);
+        if (!memory) abort();
+        TrackedBlockShard* created = static_cast<TrackedBlockShard*>(memory);
+        for (size_t i = 0; i < trackedBlockShardCount; ++i) {
+            new (&created[i]) TrackedBlockShard();
+        }
+        return created;
+    }();
+    return shards[(reinterpret_cast<uintptr_t>(block) >> 4) % trackedBlockShardCount];
+}
+
+void* trackedAllocate(size_t size) {
+    void* block;
+    while (!(block = malloc(size ? size : 1))) {
+        new_handler handler = get_new_handler();
+        if (!handler) throw bad_alloc();
+        handler();
+    }
+    if (!memoryAccounting.load(memory_order_relaxed)) return block;
+
+    MemoryTag tag = currentMemoryTag;
+    TrackedBlockShard& shard = trackedBlockShard(block);
+    try {
+        lock_guard<mutex> lock(shard.blocksMutex);
+        shard.blocks[block] = {size, tag};
+    } catch (...) {
+        free(block);
+        throw bad_alloc();
+    }
+    countAllocation(tag, static_cast<long long>(size));
+    return block;
+}
+
+void trackedFree(void* block) {
+    if (!block) return;
+    if (memoryAccounting.load(memory_order_relaxed)) {
+        TrackedBlockShard& shard = trackedBlockShard(block);
+        lock_guard<mutex> lock(shard.blocksMutex);
+        auto tracked = shard.blocks.find(block);
+        if (tracked != shard.blocks.end()) {
+            countRelease(tracked->second.tag, static_cast<long long>(tracked->second.size));
+            shard.blocks.erase(tracked);
+        }
+    }
+    free(block);
+}
+
+void* operator new(size_t size) { return trackedAllocate(size); }
+void* operator new[](size_t size) { return trackedAllocate(size); }
+void operator delete(void* pointer) noexcept { trackedFree(pointer); }
+void operator delete[](void* pointer) noexcept { trackedFree(pointer); }
+void operator delete(void* pointer, size_t) noexcept { trackedFree(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { trackedFree(pointer); }
+
+void* operator new(size_t size, const nothrow_t&) noexcept {
+    try {
+        return trackedAllocate(size);
+    } catch (const bad_alloc&) {
+        return nullptr;
+    }
+}
+void* operator new[](size_t size, const nothrow_t& tag) noexcept { return operator new(size, tag); }
+void operator delete(void* pointer, const nothrow_t&) noexcept { trackedFree(pointer); }
+void operator delete[](void* pointer, const nothrow_t&) noexcept { trackedFree(pointer); }
+
+mutex resultSizesMutex;
+unordered_map<MYSQL_RES*, long long> resultSizes;
+
+// Counts a stored result set under TagResults, sized as its row count times
+// the widest value of every column plus a pointer and terminator per value
+MYSQL_RES* trackResult(MYSQL_RES* result) {
+    if (!memoryAccounting || !result) return result;
+
+    long long rowBytes = 0;
+    unsigned int columns = mysql_num_fields(result);
+    MYSQL_FIELD* fields = mysql_fetch_fields(result);
+    for (unsigned int i = 0; i < columns; ++i) {
+        rowBytes += static_cast<long long>(fields[i].max_length) + 1 + sizeof(char*);
+    }
+    long long size = rowBytes * static_cast<long long>(mysql_num_rows(result));
+    countAllocation(TagResults, size);
+
+    MemoryTagScope scope(TagResults);
+    lock_guard<mutex> lock(resultSizesMutex);
+    resultSizes[result] = size;
+    return result;
+}
+
+void freeResult(MYSQL_RES* result) {
+    if (memoryAccounting && result) {
+        lock_guard<mutex> lock(resultSizesMutex);
+        auto tracked = resultSizes.find(result);
+        if (tracked != resultSizes.end()) {
+            countRelease(TagResults, tracked->second);
+            resultSizes.erase(tracked);
+        }
+    }
+    mysql_free_result(result);
+}
+
+struct MemorySnapshot {
+    long long allocations[MemoryTagCount];
+    long long bytes[MemoryTagCount];
+    long long liveBytes[MemoryTagCount];
+};
+
+MemorySnapshot memorySnapshot() {
+    MemorySnapshot snapshot;
+    for (int tag = 0; tag < MemoryTagCount; ++tag) {
+        snapshot.allocations[tag] = memoryCounters[tag].allocations.load(memory_order_relaxed);
+        snapshot.bytes[tag] = memoryCounters[tag].bytes.load(memory_order_relaxed);
+        snapshot.liveBytes[tag] = memoryCounters[tag].liveBytes.load(memory_order_relaxed);
+    }
+    return snapshot;
+}
+
+// Prints what each tag allocated since before and how its live bytes moved;
+// tags with no activity are left out
+void printMemoryDelta(const string& heading, const MemorySnapshot& before) {
+    MemorySnapshot now = memorySnapshot();
+    cout << "[memory] " << heading << ":";
+    bool any = false;
+    for (int tag = 0; tag < MemoryTagCount; ++tag) {
+        long long allocations = now.allocations[tag] - before.allocations[tag];
+        long long live = now.liveBytes[tag] - before.liveBytes[tag];
+        if (allocations == 0 && live == 0) continue;
+        cout << (any ? "," : "") << " " << memoryTagNames[tag] << " " << allocations << " allocation(s) "
+             << now.bytes[tag] - before.bytes[tag] << " B, live " << (live >= 0 ? "+" : "") << live << " B";
+        any = true;
+    }
+    cout << (any ? "\n" : " no allocations\n");
+}
+
+// Allocations, current (steady-state between actions) and peak live bytes
+// per tag since accounting was switched on
+void printMemoryReport() {
+    cout << "\n--- Memory by subsystem ---\n";
+    cout << "Tag\t\tAllocations\tBytes\t\tLive\t\tPeak\n";
+    for (int tag = 0; tag < MemoryTagCount; ++tag) {
+        const MemoryCounters& counters = memoryCounters[tag];
+        cout << memoryTagNames[tag] << (strlen(memoryTagNames[tag]) < 8 ? "\t\t" : "\t")
+             << counters.allocations.load() << "\t\t" << counters.bytes.load() << "\t\t"
+             << counters.liveBytes.load() << "\t\t" << counters.peakBytes.load() << "\n";
+    }
+}
+
+// Compressed set of quiz IDs (roaring-style). IDs sharing their high 16 bits
+// live in one container: a sorted array of the low halves while it has at
+// most 4096 members, a 65536-bit bitmap (8 KiB) once an array would be
+// larger. A few completed quizzes cost a few bytes, and membership is a
+// binary search over containers plus one array search or bit test.
+class QuizIdSet {
+private:
+    struct Container {
+        uint16_t key;
+        vector<uint16_t> values;  // sorted; used while bits is empty
+        vector<uint64_t> bits;
+
+        size_t size() const {
+            if (bits.empty()) return values.size();
+            size_t count = 0;
+            for (uint64_t word : bits) {
+                for (; word; word &= word - 1) ++count;
+            }
+            return count;
+        }
+
+        bool contains(uint16_t low) const {
+            if (!bits.empty()) return (bits[low >> 6] >> (low & 63)) & 1;
+            return binary_search(values.begin(), values.end(), low);
+        }
+
+        bool add(uint16_t low) {
+            if (!bits.empty()) {
+                uint64_t mask = uint64_t(1) << (low & 63);
+                if (bits[low >> 6] & mask) return false;
+                bits[low >> 6] |= mask;
+                return true;
+            }
+
+            auto at = lower_bound(values.begin(), values.end(), low);
+            if (at != values.end() && *at == low) return false;
+            values.insert(at, low);
+            if (values.size() > 4096) {
+                bits.assign(1024, 0);
+                for (uint16_t value : values) {
+                    bits[value >> 6] |= uint64_t(1) << (value & 63);
+                }
+                vector<uint16_t>().swap(values);
+            }
+            return true;
+        }
+
+        bool remove(uint16_t low) {
+            if (bits.empty()) {
+                auto at = lower_bound(values.begin(), values.end(), low);
+                if (at == values.end() || *at != low) return false;
+                values.erase(at);
+                return true;
+            }
+
+            uint64_t mask = uint64_t(1) << (low & 63);
+            if (!(bits[low >> 6] & mask)) return false;
+            bits[low >> 6] &= ~mask;
+            return true;
+        }
+    };
+
+    vector<Container> containers;  // sorted by key
+    size_t count;
+
+    vector<Container>::const_iterator findContainer(uint16_t key) const {
+        return lower_bound(containers.begin(), containers.end(), key,
+                           [](const Container& c, uint16_t k) { return c.key < k; });
+    }
+
+public:
+    QuizIdSet() : count(0) {}
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    bool contains(int id) const {
+        uint32_t value = static_cast<uint32_t>(id);
+        auto container = findContainer(static_cast<uint16_t>(value >> 16));
+        return container != containers.end() && container->key == (value >> 16) &&
+               container->contains(static_cast<uint16_t>(value));
+    }
+
+    // IDs arriving in ascending order are appended without shifting
+    void add(int id) {
+        uint32_t value = static_cast<uint32_t>(id);
+        uint16_t key = static_cast<uint16_t>(value >> 16);
+        auto at = containers.begin() + (findContainer(key) - containers.begin());
+        if (at == containers.end() || at->key != key) {
+            Container container;
+            container.key = key;
+            at = containers.insert(at, std::move(container));
+        }
+        if (at->add(static_cast<uint16_t>(value))) ++count;
+    }
+
+    void remove(int id) {
+        uint32_t value = static_cast<uint32_t>(id);
+        uint16_t key = static_cast<uint16_t>(value >> 16);
+        auto at = containers.begin() + (findContainer(key) - containers.begin());
+        if (at == containers.end() || at->key != key || !at->remove(static_cast<uint16_t>(value))) return;
+        --count;
+
+        // Back to an array once the bitmap is no longer the smaller form
+        if (!at->bits.empty() && at->size() <= 4096) {
+            for (uint32_t low = 0; low < 65536; ++low) {
+                if (at->contains(static_cast<uint16_t>(low))) at->values.push_back(static_cast<uint16_t>(low));
+            }
+            vector<uint64_t>().swap(at->bits);
+        }
+        if (at->bits.empty() && at->values.empty()) containers.erase(at);
+    }
+
+    // Up to limit members greater than afterId, ascending
+    vector<int> idsAfter(int afterId, size_t limit) const {
+        vector<int> ids;
+        uint32_t start = afterId < 0 ? 0 : static_cast<uint32_t>(afterId) + 1;
+        for (auto container = findContainer(static_cast<uint16_t>(start >> 16));
+             container != containers.end() && ids.size() < limit; ++container) {
+            uint32_t high = uint32_t(container->key) << 16;
+            uint32_t from = container->key == (start >> 16) ? (start & 0xFFFF) : 0;
+
+            if (container->bits.empty()) {
+                auto value = lower_bound(container->values.begin(), container->values.end(),
+                                         static_cast<uint16_t>(from));
+                for (; value != container->values.end() && ids.size() < limit; ++value) {
+                    ids.push_back(static_cast<int>(high | *value));
+                }
+            } else {
+                for (uint32_t low = from; low < 65536 && ids.size() < limit; ++low) {
+                    uint64_t word = container->bits[low >> 6] >> (low & 63);
+                    if (!word) {
+                        low |= 63;  // rest of this word is empty
+                        continue;
+                    }
+                    low += __builtin_ctzll(word);
+                    ids.push_back(static_cast<int>(high | low));
+                }
+            }
+        }
+        return ids;
+    }
+};
+
 // Base User class
 // Abstract base class for all users (Admin and Student)
 class User {
@@ -74,7 +486,7 @@ public:
 class Student : public User {
 private:
     int score;
-    vector<int> completedQuizzes;
+    QuizIdSet completedQuizzes;
 
 public:
     Student(int id, const string& username, const string& password)
@@ -84,6 +496,7 @@ public:
     void takeQuiz(Quiz& quiz);
     void updateScore(int points) { score += points; }
     int getScore() const { return score; }
+    void setCompletedQuizzes(const QuizIdSet& quizIds) { completedQuizzes = quizIds; }
 };
 
 // Question class
@@ -126,15 +539,20 @@ private:
     string title;
     string description;
     vector<Question> questions;
+    int questionCount;  // Known count when the questions themselves aren't loaded
 
 public:
     Quiz(int id, const string& title, const string& description)
-        : id(id), title(title), description(description) {}
+        : id(id), title(title), description(description), questionCount(0) {}
 
     int getId() const { return id; }
     string getTitle() const { return title; }
     string getDescription() const { return description; }
     const vector<Question>& getQuestions() const { return questions; }
+    void setQuestionCount(int count) { questionCount = count; }
+    int getQuestionCount() const {
+        return questions.empty() ? questionCount : static_cast<int>(questions.size());
+    }
 
     void addQuestion(const Question& question) {
         questions.push_back(question);
@@ -143,10 +561,12 @@ public:
     void display() const {
         cout << "\nQuiz: " << title << "\n";
         cout << "Description: " << description << "\n";
-        cout << "Number of Questions: " << questions.size() << "\n";
+        cout << "Number of Questions: " << getQuestionCount() << "\n";
     }
 
-    void startQuiz(Student& student) {
+    // Runs the quiz interactively and returns the score of this attempt only.
+    // Each answer is appended to responses, when given, as (question ID, correct).
+    int startQuiz(vector<pair<int, bool>>* responses = nullptr) const {
         int score = 0;
         cout << "\nStarting Quiz: " << title << "\n";
 
@@ -156,7 +576,10 @@ public:
             int choice;
             cin >> choice;
 
-            if (question.checkAnswer(choice)) {
+            bool correct = question.checkAnswer(choice);
+            if (responses) responses->push_back({question.getId(), correct});
+
+            if (correct) {
                 cout << "Correct!\n";
                 score++;
             } else {
@@ -165,7 +588,7 @@ public:
         }
 
         cout << "\nQuiz completed! Your score: " << score << "/" << questions.size() << "\n";
-        student.updateScore(score);
+        return score;
     }
 };
 
@@ -174,273 +597,4625 @@ public:
         string role;
     };
 
-// Database Manager class
-// DatabaseManager handles all MySQL interactions
-class DatabaseManager {
+// Item parameters of one quiz under the three-parameter logistic model,
+// held in parallel arrays. Items are grouped into bands of similar guessing
+// rate and slope and sorted by difficulty within each band, which lets
+// nextItem skip most of the bank. Slopes are stored already scaled by 1.7.
+class ItemBank {
 private:
-    MYSQL* conn;
-    string server;
-    string user;
-    string password;
-    string database;
+    struct Band {
+        size_t begin, end;
+        float minSlope, maxSlope, minGuessing;
+        double peakLogistic;  // Logistic value where information peaks at minGuessing
+        double peakBound;
+    };
+
+    vector<int> questionIds;
+    vector<float> slopes;
+    vector<float> difficulties;
+    vector<float> guessing;
+    vector<Band> bands;  // Highest peakBound first
+
+    // Information of an item with guessing rate c as a function of its
+    // logistic value, divided by the squared slope. Falls as c grows and
+    // peaks at the band's peakLogistic.
+    static double scaledInformation(double logistic, double c) {
+        return (1 - c) * logistic * logistic * (1 - logistic) / (c + (1 - c) * logistic);
+    }
+
+    // Upper bound on the information at theta of any item in the band whose
+    // difficulty is theta - offset. Over the band's slopes the logistic
+    // value stays within [low, high], so the bound is the scaled curve at
+    // the point of that range closest to its peak.
+    static double informationBound(const Band& band, double offset) {
+        double low = 1 / (1 + exp(-min(band.minSlope * offset, band.maxSlope * offset)));
+        double high = 1 / (1 + exp(-max(band.minSlope * offset, band.maxSlope * offset)));
+        double logistic = min(high, max(low, band.peakLogistic));
+        return double(band.maxSlope) * band.maxSlope * scaledInformation(logistic, band.minGuessing);
+    }
 
 public:
-    DatabaseManager(const string& server, const string& user,
-                   const string& password, const string& database)
-        : server(server), user(user), password(password), database(database) {
-        conn = mysql_init(nullptr);
-        if (!conn) {
-            cerr << "MySQL initialization failed" << endl;
-            exit(1);
-        }
+    void add(int questionId, double discrimination, double difficulty, double guessRate) {
+        questionIds.push_back(questionId);
+        slopes.push_back(static_cast<float>(1.7 * min(4.0, max(0.05, discrimination))));
+        difficulties.push_back(static_cast<float>(difficulty));
+        guessing.push_back(static_cast<float>(min(0.5, max(0.0, guessRate))));
+    }
 
-        if (!mysql_real_connect(conn, server.c_str(), user.c_str(),
-                              password.c_str(), database.c_str(), 0, nullptr, 0)) {
-            cerr << "Connection Error: " << mysql_error(conn) << endl;
-            exit(1);
+    // Sorts the items into bands; call once after the last add
+    void finalize() {
+        vector<size_t> order(questionIds.size());
+        for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+        sort(order.begin(), order.end(), [this](size_t x, size_t y) {
+            return guessing[x] != guessing[y] ? guessing[x] < guessing[y] : slopes[x] < slopes[y];
+        });
+
+        ItemBank sorted;
+        // Narrow bands tighten the bound; about 2 * sqrt(n) items each keeps
+        // the per-band binary searches cheap as well
+        size_t bandSize = max<size_t>(32, static_cast<size_t>(2 * sqrt(double(order.size()))));
+        for (size_t begin = 0; begin < order.size(); begin += bandSize) {
+            size_t end = min(order.size(), begin + bandSize);
+            sort(order.begin() + begin, order.begin() + end,
+                 [this](size_t x, size_t y) { return difficulties[x] < difficulties[y]; });
+
+            Band band = {begin, end, numeric_limits<float>::max(), 0, 1, 0, 0};
+            for (size_t k = begin; k < end; ++k) {
+                size_t i = order[k];
+                sorted.questionIds.push_back(questionIds[i]);
+                sorted.slopes.push_back(slopes[i]);
+                sorted.difficulties.push_back(difficulties[i]);
+                sorted.guessing.push_back(guessing[i]);
+                band.minSlope = min(band.minSlope, slopes[i]);
+                band.maxSlope = max(band.maxSlope, slopes[i]);
+                band.minGuessing = min(band.minGuessing, guessing[i]);
+            }
+            double ratio = (1 + sqrt(1 + 8.0 * band.minGuessing)) / 2;
+            band.peakLogistic = ratio / (1 + ratio);
+            band.peakBound = double(band.maxSlope) * band.maxSlope *
+                             scaledInformation(band.peakLogistic, band.minGuessing);
+            sorted.bands.push_back(band);
         }
+        sort(sorted.bands.begin(), sorted.bands.end(),
+             [](const Band& x, const Band& y) { return x.peakBound > y.peakBound; });
+        *this = move(sorted);
+    }
+
+    size_t size() const { return questionIds.size(); }
+    int questionId(size_t item) const { return questionIds[item]; }
 
-        initializeDatabase();
+    // Chance that a student of ability theta answers the item correctly
+    double probability(size_t item, double theta) const {
+        double c = guessing[item];
+        return c + (1 - c) / (1 + exp(-slopes[item] * (theta - difficulties[item])));
     }
 
-    ~DatabaseManager() {
-        mysql_close(conn);
+    // Fisher information of the item at theta
+    double information(size_t item, double theta) const {
+        double c = guessing[item];
+        double logistic = 1 / (1 + exp(-slopes[item] * (theta - difficulties[item])));
+        double p = c + (1 - c) * logistic;
+        return double(slopes[item]) * slopes[item] * (1 - c) * logistic * logistic * (1 - logistic) / p;
     }
 
-    void executeQuery(const string& query) {
-        if (mysql_query(conn, query.c_str())) {
-            cerr << "MySQL Query Error: " << mysql_error(conn) << endl;
+    // Most informative item at theta that is not marked in used, or -1 when
+    // every item is used. Visits the most promising bands first and walks
+    // each one outward from theta. Above theta the bound only falls; below
+    // it the bound rises until the offset passes the band's peak, so a side
+    // is abandoned once the bound no longer beats the best item so far and
+    // can only fall further.
+    long nextItem(double theta, const vector<char>& used) const {
+        long best = -1;
+        double bestInformation = -1;
+
+        for (const Band& band : bands) {
+            if (band.peakBound <= bestInformation) break;
+
+            size_t right = lower_bound(difficulties.begin() + band.begin, difficulties.begin() + band.end,
+                                       theta) - difficulties.begin();
+            size_t left = right;
+            bool rightOpen = right < band.end, leftOpen = left > band.begin;
+            while (rightOpen || leftOpen) {
+                bool goRight = rightOpen &&
+                    (!leftOpen || difficulties[right] - theta <= theta - difficulties[left - 1]);
+                size_t item = goRight ? right++ : --left;
+                double offset = theta - difficulties[item];
+
+                if (informationBound(band, offset) <= bestInformation) {
+                    if (goRight) {
+                        rightOpen = false;
+                    } else if (1 / (1 + exp(-band.minSlope * offset)) >= band.peakLogistic) {
+                        leftOpen = false;
+                    }
+                } else if (!used[item]) {
+                    double itemInformation = information(item, theta);
+                    if (itemInformation > bestInformation) {
+                        bestInformation = itemInformation;
+                        best = static_cast<long>(item);
+                    }
+                }
+                if (right == band.end) rightOpen = false;
+                if (left == band.begin) leftOpen = false;
+            }
         }
+        return best;
     }
 
-    MYSQL_RES* executeQueryWithResult(const string& query) {
-        if (mysql_query(conn, query.c_str())) {
-            cerr << "MySQL Query Error: " << mysql_error(conn) << endl;
-            return nullptr;
+    // Expected number of correct answers over the whole bank at theta, so an
+    // adaptive result is on the same scale as answering every question
+    double expectedScore(double theta) const {
+        double total = 0;
+        for (size_t item = 0; item < size(); ++item) {
+            total += probability(item, theta);
         }
-        return mysql_store_result(conn);
+        return total;
     }
+};
 
-    void initializeDatabase() {
-        // Create tables if they don't exist
-        vector<string> createTables = {
-            "CREATE TABLE IF NOT EXISTS users ("
-            "id INT AUTO_INCREMENT PRIMARY KEY,"
-            "username VARCHAR(50) NOT NULL,"
-            "password VARCHAR(100) NOT NULL,"
-            "role ENUM('admin', 'student') NOT NULL,"
-            "score INT DEFAULT 0,"
-            "CONSTRAINT username_role_unique UNIQUE (username, role))",
+// Posterior over a student's ability on a fixed grid with a standard
+// normal prior, updated after each answer (expected a posteriori estimate)
+class AbilityEstimate {
+private:
+    static const int gridPoints = 61;
+    double logPosterior[gridPoints];
+    double estimate = 0;
+    double standardError = 1;
 
-            "CREATE TABLE IF NOT EXISTS quizzes ("
-            "id INT AUTO_INCREMENT PRIMARY KEY,"
-            "title VARCHAR(100) NOT NULL,"
-            "description TEXT,"
-            "time_limit INT)",
+    static double gridTheta(int point) { return -4.0 + 8.0 * point / (gridPoints - 1); }
 
-            "CREATE TABLE IF NOT EXISTS questions ("
-            "id INT AUTO_INCREMENT PRIMARY KEY,"
-            "quiz_id INT NOT NULL,"
-            "text TEXT NOT NULL,"
-            "option1 TEXT NOT NULL,"
-            "option2 TEXT NOT NULL,"
-            "option3 TEXT,"
-            "option4 TEXT,"
-            "correct_option INT NOT NULL,"
-            "FOREIGN KEY (quiz_id) REFERENCES quizzes(id) ON DELETE CASCADE)",
+public:
+    AbilityEstimate() {
+        for (int point = 0; point < gridPoints; ++point) {
+            logPosterior[point] = -0.5 * gridTheta(point) * gridTheta(point);
+        }
+    }
 
-            "CREATE TABLE IF NOT EXISTS student_quizzes ("
-            "student_id INT NOT NULL,"
-            "quiz_id INT NOT NULL,"
-            "score INT NOT NULL,"
-            "completed_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,"
-            "PRIMARY KEY (student_id, quiz_id),"
-            "FOREIGN KEY (student_id) REFERENCES users(id) ON DELETE CASCADE,"
-            "FOREIGN KEY (quiz_id) REFERENCES quizzes(id) ON DELETE CASCADE)"
-        };
+    void update(const ItemBank& bank, size_t item, bool correct) {
+        double peak = -numeric_limits<double>::infinity();
+        for (int point = 0; point < gridPoints; ++point) {
+            double p = bank.probability(item, gridTheta(point));
+            logPosterior[point] += log(correct ? p : 1 - p);
+            peak = max(peak, logPosterior[point]);
+        }
 
-        for (const auto& query : createTables) {
-            executeQuery(query);
+        double weightSum = 0, mean = 0, square = 0;
+        for (int point = 0; point < gridPoints; ++point) {
+            double weight = exp(logPosterior[point] - peak);
+            weightSum += weight;
+            mean += weight * gridTheta(point);
+            square += weight * gridTheta(point) * gridTheta(point);
         }
+        mean /= weightSum;
+        estimate = mean;
+        standardError = sqrt(max(0.0, square / weightSum - mean * mean));
     }
 
-    unique_ptr<User> authenticateUser(const string& username, const string& password) {
-        string query = "SELECT id, username, password, role, score FROM users WHERE username = '" +
-                      escapeString(username) + "'";
+    double theta() const { return estimate; }
+    double error() const { return standardError; }
+
+    // Stopping rule for adaptive quizzes: at least 5 questions, then stop
+    // once the standard error drops to 0.35 or after 20 questions
+    bool settled(size_t questionsAsked) const {
+        return questionsAsked >= 20 || (questionsAsked >= 5 && standardError <= 0.35);
+    }
+};
 
-        MYSQL_RES* result = executeQueryWithResult(query);
-        if (!result) return nullptr;
+// One published version of the quiz cache. Never modified after it is
+// published; a change copies the map, which shares the unchanged quizzes.
+struct CatalogSnapshot {
+    uint64_t version = 0;
+    map<int, shared_ptr<const Quiz>> quizzes;
+};
 
-        MYSQL_ROW row = mysql_fetch_row(result);
-        if (row) {
-            int id = stoi(row[0]);
-            string dbUsername = row[1];
-            string dbPassword = row[2];
-            string role = row[3];
+// Quiz cache published as immutable snapshots (read-copy-update). Readers
+// never lock: they announce the current epoch in a slot, load the snapshot
+// pointer and clear the slot when done. Writers are serialized, publish a
+// new snapshot with one pointer swap and free an old snapshot only once no
+// slot still holds an epoch from before the swap. An attempt in progress
+// keeps its quiz alive through the shared_ptr from pin, whatever is
+// published meanwhile.
+class CatalogStore {
+private:
+    static const size_t readerSlots = 64;
 
-            if (dbPassword == password) {
-                mysql_free_result(result);
+    struct ReaderSlot {
+        atomic<uint64_t> epoch{0};  // 0 when free
+        char padding[64 - sizeof(atomic<uint64_t>)];
+    };
 
-                if (role == "admin") {
-                    return std::make_unique<Admin>(id, dbUsername, dbPassword);
-                } else {
-                    auto student = std::make_unique<Student>(id, dbUsername, dbPassword);
-                    student->updateScore(row[4] ? stoi(row[4]) : 0);
-                    return std::unique_ptr<User>(std::move(student));
+    // Marks a slot busy for the lifetime of the guard
+    class ReadGuard {
+    private:
+        ReaderSlot* slot;
+
+    public:
+        explicit ReadGuard(const CatalogStore& store) : slot(nullptr) {
+            static thread_local size_t hint = hash<thread::id>()(this_thread::get_id());
+            for (size_t i = 0;; ++i) {
+                ReaderSlot& candidate = store.slots[(hint + i) % readerSlots];
+                uint64_t free = 0;
+                if (candidate.epoch.load(memory_order_relaxed) == 0 &&
+                    candidate.epoch.compare_exchange_strong(free, store.epoch.load())) {
+                    slot = &candidate;
+                    hint += i;
+                    return;
                 }
             }
         }
+        ~ReadGuard() { slot->epoch.store(0, memory_order_release); }
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+    };
 
-        mysql_free_result(result);
-        return nullptr;
+    atomic<const CatalogSnapshot*> current;
+    atomic<uint64_t> epoch{1};
+    mutable ReaderSlot slots[readerSlots];
+
+    mutex writerMutex;
+    vector<pair<uint64_t, const CatalogSnapshot*>> retired;  // Epoch of retirement, snapshot
+
+    void reclaim() {
+        uint64_t oldestReader = numeric_limits<uint64_t>::max();
+        for (const ReaderSlot& slot : slots) {
+            uint64_t readerEpoch = slot.epoch.load();
+            if (readerEpoch != 0) oldestReader = min(oldestReader, readerEpoch);
+        }
+        auto stillRead = remove_if(retired.begin(), retired.end(),
+                                   [oldestReader](const pair<uint64_t, const CatalogSnapshot*>& old) {
+            if (old.first >= oldestReader) return false;
+            delete old.second;
+            return true;
+        });
+        retired.erase(stillRead, retired.end());
     }
 
+public:
+    CatalogStore() : current(new CatalogSnapshot()) {}
 
-bool registerUser(const string& username, const string& password, const string& role) {
-    // Check if username+role combination already exists
-    string checkQuery = "SELECT id FROM users WHERE username = '" + escapeString(username) +
-                       "' AND role = '" + escapeString(role) + "'";
+    ~CatalogStore() {
+        delete current.load();
+        for (const auto& old : retired) {
+            delete old.second;
+        }
+    }
 
-    MYSQL_RES* result = executeQueryWithResult(checkQuery);
-    if (result && mysql_num_rows(result) > 0) {
-        mysql_free_result(result);
-        return false; // Username already exists for this specific role
+    CatalogStore(const CatalogStore&) = delete;
+    CatalogStore& operator=(const CatalogStore&) = delete;
+
+    // Runs reader on the current snapshot. The snapshot is only valid
+    // inside the call; copy out any quiz that must outlive it.
+    template <typename Reader>
+    auto read(Reader reader) const -> decltype(reader(declval<const CatalogSnapshot&>())) {
+        ReadGuard guard(*this);
+        return reader(*current.load());
     }
-    if (result) mysql_free_result(result);
 
-    // Insert new user
-    string query = "INSERT INTO users (username, password, role) VALUES ('" +
-                  escapeString(username) + "', '" +
-                  escapeString(password) + "', '" +
-                  escapeString(role) + "')";
+    // The cached quiz, or nullptr when it isn't cached
+    shared_ptr<const Quiz> pin(int quizId) const {
+        return read([quizId](const CatalogSnapshot& snapshot) {
+            auto found = snapshot.quizzes.find(quizId);
+            return found == snapshot.quizzes.end() ? shared_ptr<const Quiz>() : found->second;
+        });
+    }
+
+    uint64_t version() const {
+        return read([](const CatalogSnapshot& snapshot) { return snapshot.version; });
+    }
+
+    // Publishes a copy of the current snapshot with change applied. With a
+    // nonzero basedOn nothing is published if another change has landed
+    // since that version; returns whether the change was published.
+    bool update(const function<void(CatalogSnapshot&)>& change, uint64_t basedOn = 0) {
+        lock_guard<mutex> lock(writerMutex);
+        const CatalogSnapshot* old = current.load();
+        if (basedOn != 0 && old->version != basedOn) return false;
+
+        unique_ptr<CatalogSnapshot> next(new CatalogSnapshot(*old));
+        change(*next);
+        next->version = old->version + 1;
+
+        current.store(next.release());
+        retired.push_back({epoch.fetch_add(1), old});
+        reclaim();
+        return true;
+    }
+};
+
+// A row of catalog_changes; questionId is 0 for a change to the quiz itself
+// and quizId is 0 when a deleted question's quiz wasn't recorded
+struct CatalogChange {
+    int quizId;
+    int questionId;
+    bool deleted;
+};
 
-    return mysql_query(conn, query.c_str()) == 0;
+// A MySQL server address; port 0 means the client library default
+struct DbEndpoint {
+    string host;
+    unsigned int port;
+};
+
+// Parses "host" or "host:port"
+DbEndpoint parseEndpoint(const string& text) {
+    size_t colon = text.rfind(':');
+    if (colon == string::npos) {
+        return {text, 0};
+    }
+    return {text.substr(0, colon), static_cast<unsigned int>(stoi(text.substr(colon + 1)))};
 }
 
-    vector<Quiz> getAllQuizzes() {
-        vector<Quiz> quizzes;
-        string query = "SELECT id, title, description, time_limit FROM quizzes";
+// Cost settings for new hashes; memory per hash is 128 * r * 2^costLog2 bytes
+struct ScryptParams {
+    int costLog2;
+    uint32_t blockSize;
+    uint32_t parallelism;
+};
+
+// Connection settings: writes go to the primary, reads are spread over the
+// replicas. After a write, reads stay on the primary for
+// readYourWritesSeconds so a session always sees its own changes.
+struct DatabaseConfig {
+    DbEndpoint primary;
+    vector<DbEndpoint> replicas;
+    string user;
+    string password;
+    string database;
+    int readYourWritesSeconds;
+    ScryptParams passwordHashing;
+    size_t hashingThreads;
+    string tracePath;  // record every statement here when set
+    // Extra databases holding a share of the users and their attempts; the
+    // primary is shard 0. Every process must list the same shards in order.
+    vector<DbEndpoint> shards;
+    string journalPath;  // quiz attempts are journaled here first; empty writes directly
+};
 
-        MYSQL_RES* result = executeQueryWithResult(query);
-        if (!result) return quizzes;
+// In-memory inverted index over quiz titles and descriptions and question
+// text and options. Every query token matches as a prefix, a result must
+// match all tokens, and results are ranked by field-weighted IDF. Deleted
+// documents are tombstoned, skipped at query time and left out of IDF; once
+// they outnumber the live ones (and there are at least 1024) the index is
+// rebuilt without them.
+class SearchIndex {
+public:
+    enum Kind { QuizDoc = 0, QuestionDoc = 1 };
 
-        MYSQL_ROW row;
-        while ((row = mysql_fetch_row(result))) {
-            int id = stoi(row[0]);
-            string title = row[1] ? row[1] : "";
-            string description = row[2] ? row[2] : "";
-            int timeLimit = row[3] ? stoi(row[3]) : 0;
+    struct Hit {
+        Kind kind;
+        int id;
+        int quizId;
+        string text;
+        double score;
+    };
 
-            Quiz quiz(id, title, description);
+private:
+    struct Posting {
+        int doc;
+        float weight;
+    };
 
-            // Load questions for this quiz
-            string questionQuery = "SELECT id, text, option1, option2, option3, option4, correct_option "
-                                 "FROM questions WHERE quiz_id = " + to_string(id);
-            MYSQL_RES* questionResult = executeQueryWithResult(questionQuery);
+    struct TermPostings {
+        vector<Posting> list;
+        size_t liveDocs;  // postings of documents not removed, for IDF
+    };
 
-            if (questionResult) {
-                MYSQL_ROW questionRow;
-                while ((questionRow = mysql_fetch_row(questionResult))) {
-                    int qid = stoi(questionRow[0]);
-                    string text = questionRow[1] ? questionRow[1] : "";
+    struct Document {
+        Kind kind;
+        int id;
+        int quizId;
+        string text;
+        bool alive;
+        vector<TermPostings*> terms;  // every term the document is posted under
+    };
 
-                    vector<string> options;
-                    options.push_back(questionRow[2] ? questionRow[2] : "");
-                    options.push_back(questionRow[3] ? questionRow[3] : "");
+    // A dictionary term matched by one query token
+    struct TermMatch {
+        const vector<Posting>* postings;
+        float factor;
+    };
 
-                    if (questionRow[4]) options.push_back(questionRow[4]);
-                    if (questionRow[5]) options.push_back(questionRow[5]);
+    vector<Document> docs;
+    map<string, TermPostings> postings;  // Ordered, so prefixes are a range
+    unordered_map<long long, int> docByKey;
+    unordered_map<int, vector<int>> questionDocsByQuiz;
+    size_t liveDocs;
+    mutable vector<float> accumulator;  // Per-document scratch scores, kept zeroed
 
-                    int correctOption = questionRow[6] ? stoi(questionRow[6]) : 1;
+    static long long key(Kind kind, int id) {
+        return (static_cast<long long>(id) << 1) | kind;
+    }
 
-                    quiz.addQuestion(Question(qid, text, options, correctOption, id));
-                }
-                mysql_free_result(questionResult);
+    void indexField(int doc, const string& text, float weight) {
+        for (const auto& token : tokenize(text)) {
+            TermPostings& term = postings[token];
+            if (!term.list.empty() && term.list.back().doc == doc) {
+                term.list.back().weight += weight;
+            } else {
+                term.list.push_back({doc, weight});
+                ++term.liveDocs;
+                docs[doc].terms.push_back(&term);
             }
-
-            quizzes.push_back(quiz);
         }
-
-        mysql_free_result(result);
-        return quizzes;
     }
 
-    bool addQuiz(const Quiz& quiz) {
-        string query = "INSERT INTO quizzes (title, description) VALUES ('" +
-                  escapeString(quiz.getTitle()) + "', '" +
-                  escapeString(quiz.getDescription()) + "')";
+    int addDocument(Kind kind, int id, int quizId, const string& text) {
+        int doc = static_cast<int>(docs.size());
+        docs.push_back({kind, id, quizId, text, true, {}});
+        docByKey[key(kind, id)] = doc;
+        ++liveDocs;
+        return doc;
+    }
 
-        if (mysql_query(conn, query.c_str())) {
-            cerr << "Error: " << mysql_error(conn) << endl;
-            return false;
+    void removeDocument(Kind kind, int id) {
+        auto it = docByKey.find(key(kind, id));
+        if (it == docByKey.end()) return;
+        Document& doc = docs[it->second];
+        doc.alive = false;
+        for (TermPostings* term : doc.terms) {
+            --term->liveDocs;
         }
+        vector<TermPostings*>().swap(doc.terms);
+        docByKey.erase(it);
+        --liveDocs;
+    }
 
-        int quizId = static_cast<int>(mysql_insert_id(conn));
-
-        // Add questions
-        for (const auto& question : quiz.getQuestions()) {
-            addQuestion(quizId, question);
+    // Rebuilds the index without removed documents once they are the
+    // majority, so admin churn doesn't grow it without bound. Document
+    // numbers are reassigned in order, which keeps posting lists sorted.
+    // Called only at the end of public methods, since it renumbers.
+    void compactIfNeeded() {
+        size_t dead = docs.size() - liveDocs;
+        if (dead < 1024 || dead < liveDocs) return;
+
+        vector<int> renumbered(docs.size(), -1);
+        vector<Document> kept;
+        kept.reserve(liveDocs);
+        for (size_t doc = 0; doc < docs.size(); ++doc) {
+            if (!docs[doc].alive) continue;
+            renumbered[doc] = static_cast<int>(kept.size());
+            kept.push_back(std::move(docs[doc]));
+        }
+        docs.swap(kept);
+
+        // A term left without postings has no live document pointing at it
+        for (auto it = postings.begin(); it != postings.end();) {
+            vector<Posting>& list = it->second.list;
+            size_t count = 0;
+            for (const auto& posting : list) {
+                if (renumbered[posting.doc] >= 0) list[count++] = {renumbered[posting.doc], posting.weight};
+            }
+            list.resize(count);
+            list.shrink_to_fit();
+            it = list.empty() ? postings.erase(it) : next(it);
         }
 
-        return true;
+        for (auto& entry : docByKey) {
+            entry.second = renumbered[entry.second];
+        }
+        for (auto it = questionDocsByQuiz.begin(); it != questionDocsByQuiz.end();) {
+            vector<int>& quizDocs = it->second;
+            size_t count = 0;
+            for (int doc : quizDocs) {
+                if (renumbered[doc] >= 0) quizDocs[count++] = renumbered[doc];
+            }
+            quizDocs.resize(count);
+            it = quizDocs.empty() ? questionDocsByQuiz.erase(it) : next(it);
+        }
+        vector<float>().swap(accumulator);
     }
 
-    bool addQuestion(int quizId, const Question& question) {
-        string query = "INSERT INTO questions (quiz_id, text, option1, option2, option3, option4, correct_option) VALUES (" +
+    // Dictionary terms that start with the token. One-letter tokens only match
+    // exactly, since their prefix ranges cover most of the dictionary. Beyond
+    // maxExpansions terms, probing each one per candidate gets slow, so all
+    // of them are folded into one posting list in merged, weights already
+    // scaled by their term's factor; every matching document still counts.
+    vector<TermMatch> expand(const string& token, size_t& estimate, vector<Posting>& merged) const {
+        const size_t maxExpansions = 64;
+        vector<TermMatch> matches;
+        estimate = 0;
+
+        double total = static_cast<double>(max<size_t>(liveDocs, 1));
+        for (auto it = postings.lower_bound(token);
+             it != postings.end() && it->first.compare(0, token.size(), token) == 0;
+             ++it) {
+            bool exact = it->first.size() == token.size();
+            if (!exact && token.size() < 2) break;
+            if (it->second.liveDocs == 0) continue;
+
+            float idf = static_cast<float>(log(1.0 + total / it->second.liveDocs));
+            matches.push_back({&it->second.list, exact ? idf : idf * 0.7f});
+            estimate += it->second.list.size();
+        }
+        if (matches.size() <= maxExpansions) return matches;
+
+        merged.reserve(estimate);
+        for (const auto& match : matches) {
+            for (const auto& posting : *match.postings) {
+                merged.push_back({posting.doc, posting.weight * match.factor});
+            }
+        }
+        sort(merged.begin(), merged.end(), [](const Posting& a, const Posting& b) { return a.doc < b.doc; });
+        size_t count = 0;
+        for (const auto& posting : merged) {
+            if (count > 0 && merged[count - 1].doc == posting.doc) {
+                merged[count - 1].weight += posting.weight;
+            } else {
+                merged[count++] = posting;
+            }
+        }
+        merged.resize(count);
+
+        estimate = merged.size();
+        matches.assign(1, TermMatch{&merged, 1.0f});
+        return matches;
+    }
+
+    static float weightIn(const vector<TermMatch>& matches, int doc) {
+        float score = 0;
+        for (const auto& match : matches) {
+            auto it = lower_bound(match.postings->begin(), match.postings->end(), doc,
+                                  [](const Posting& p, int d) { return p.doc < d; });
+            if (it != match.postings->end() && it->doc == doc) {
+                score += it->weight * match.factor;
+            }
+        }
+        return score;
+    }
+
+public:
+    SearchIndex() : liveDocs(0) {}
+
+    // Lower-cased runs of letters and digits; bytes >= 0x80 are kept so that
+    // UTF-8 words stay whole
+    static vector<string> tokenize(const string& text) {
+        vector<string> tokens;
+        string current;
+        for (unsigned char c : text) {
+            if (isalnum(c) || c >= 0x80) {
+                current += static_cast<char>(tolower(c));
+            } else if (!current.empty()) {
+                tokens.push_back(current);
+                current.clear();
+            }
+        }
+        if (!current.empty()) tokens.push_back(current);
+        return tokens;
+    }
+
+    void clear() {
+        docs.clear();
+        postings.clear();
+        docByKey.clear();
+        questionDocsByQuiz.clear();
+        liveDocs = 0;
+        accumulator.clear();
+    }
+
+    void addQuiz(int id, const string& title, const string& description) {
+        removeDocument(QuizDoc, id);
+        int doc = addDocument(QuizDoc, id, id, title);
+        indexField(doc, title, 3.0f);
+        indexField(doc, description, 1.0f);
+        compactIfNeeded();
+    }
+
+    void addQuestion(int id, int quizId, const string& text, const vector<string>& options) {
+        removeDocument(QuestionDoc, id);
+        int doc = addDocument(QuestionDoc, id, quizId, text);
+        indexField(doc, text, 2.0f);
+        for (const auto& option : options) {
+            indexField(doc, option, 1.0f);
+        }
+        questionDocsByQuiz[quizId].push_back(doc);
+        compactIfNeeded();
+    }
+
+    // Also drops the quiz's questions, mirroring ON DELETE CASCADE
+    void removeQuiz(int id) {
+        removeDocument(QuizDoc, id);
+        auto it = questionDocsByQuiz.find(id);
+        if (it != questionDocsByQuiz.end()) {
+            for (int doc : it->second) {
+                if (docs[doc].alive) removeDocument(QuestionDoc, docs[doc].id);
+            }
+            questionDocsByQuiz.erase(it);
+        }
+        compactIfNeeded();
+    }
+
+    void removeQuestion(int id) {
+        removeDocument(QuestionDoc, id);
+        compactIfNeeded();
+    }
+
+    // Not safe to call concurrently: queries share the score accumulator
+    vector<Hit> search(const string& query, Kind kind, size_t limit) const {
+        vector<Hit> hits;
+        vector<string> tokens = tokenize(query);
+        sort(tokens.begin(), tokens.end());
+        tokens.erase(unique(tokens.begin(), tokens.end()), tokens.end());
+        if (tokens.empty()) return hits;
+
+        // Expand every token and start from the one with the fewest postings
+        vector<pair<size_t, vector<TermMatch>>> expanded;
+        deque<vector<Posting>> merged;  // lists folded by expand(), kept at stable addresses
+        for (const auto& token : tokens) {
+            size_t estimate;
+            merged.emplace_back();
+            vector<TermMatch> matches = expand(token, estimate, merged.back());
+            if (matches.empty()) return hits;
+            expanded.push_back(make_pair(estimate, std::move(matches)));
+        }
+        sort(expanded.begin(), expanded.end(),
+             [](const pair<size_t, vector<TermMatch>>& a, const pair<size_t, vector<TermMatch>>& b) {
+                 return a.first < b.first;
+             });
+
+        // Accumulate the seed token's scores densely, then probe the others
+        accumulator.resize(docs.size(), 0.0f);
+        vector<int> touched;
+        for (const auto& match : expanded[0].second) {
+            for (const auto& posting : *match.postings) {
+                if (accumulator[posting.doc] == 0.0f) touched.push_back(posting.doc);
+                accumulator[posting.doc] += posting.weight * match.factor;
+            }
+        }
+
+        vector<pair<int, float>> scored;
+        for (int doc : touched) {
+            if (docs[doc].alive && docs[doc].kind == kind) {
+                scored.push_back(make_pair(doc, accumulator[doc]));
+            }
+            accumulator[doc] = 0.0f;
+        }
+        for (size_t t = 1; t < expanded.size() && !scored.empty(); ++t) {
+            size_t kept = 0;
+            for (auto& candidate : scored) {
+                float weight = weightIn(expanded[t].second, candidate.first);
+                if (weight > 0) {
+                    scored[kept++] = make_pair(candidate.first, candidate.second + weight);
+                }
+            }
+            scored.resize(kept);
+        }
+
+        size_t top = min(limit, scored.size());
+        partial_sort(scored.begin(), scored.begin() + top, scored.end(),
+                     [](const pair<int, float>& a, const pair<int, float>& b) {
+                         return a.second > b.second;
+                     });
+        for (size_t i = 0; i < top; ++i) {
+            const Document& doc = docs[scored[i].first];
+            hits.push_back({doc.kind, doc.id, doc.quizId, doc.text, scored[i].second});
+        }
+        return hits;
+    }
+};
+
+// MinHash signatures with LSH banding for near-duplicate questions. A
+// question is shingled into character 4-grams of its normalized text and
+// options. Only questions that share a band bucket are compared, so a lookup
+// costs time proportional to the number of likely matches, not the bank size.
+class NearDuplicateDetector {
+public:
+    struct Match {
+        int id;
+        int quizId;
+        string text;
+        double similarity;  // Estimated Jaccard similarity of the shingle sets
+    };
+
+    struct DuplicatePair {
+        Match first;
+        Match second;
+    };
+
+private:
+    static const int hashCount = 64;
+    static const int bandCount = 16;
+    static const int rowsPerBand = hashCount / bandCount;
+
+    vector<uint32_t> signatures;  // hashCount values per slot, contiguous
+    vector<int> ids;              // -1 for removed slots
+    vector<int> quizIds;
+    vector<string> texts;
+    unordered_map<int, int> slotById;
+    // LSH buckets as intrusive lists: bucketHeads maps a band key to the
+    // newest slot in that bucket, bucketNext links each (slot, band) onward
+    unordered_map<uint64_t, int> bucketHeads;
+    vector<int> bucketNext;
+
+    static uint64_t mix(uint64_t x) {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ULL;
+        x ^= x >> 33;
+        return x;
+    }
+
+    // Options are sorted so reordered answer choices still match
+    static vector<uint32_t> signature(const string& text, const vector<string>& options) {
+        string normalized;
+        for (const auto& token : SearchIndex::tokenize(text)) {
+            normalized += token + " ";
+        }
+        vector<string> sortedOptions(options);
+        sort(sortedOptions.begin(), sortedOptions.end());
+        for (const auto& option : sortedOptions) {
+            normalized += "|";
+            for (const auto& token : SearchIndex::tokenize(option)) {
+                normalized += token + " ";
+            }
+        }
+
+        // Each of the hashCount permutations is x -> a * x + b over 32 bits
+        // (a odd) applied to a well-mixed shingle hash; 32-bit lanes let the
+        // inner loop vectorize
+        struct Permutations {
+            uint32_t multipliers[hashCount];
+            uint32_t offsets[hashCount];
+
+            Permutations() {
+                for (int k = 0; k < hashCount; ++k) {
+                    multipliers[k] = static_cast<uint32_t>(mix(2 * k + 1)) | 1;
+                    offsets[k] = static_cast<uint32_t>(mix(2 * k + 2));
+                }
+            }
+        };
+        static const Permutations permutations;
+
+        uint32_t minimums[hashCount];
+        fill(minimums, minimums + hashCount, UINT32_MAX);
+        const size_t shingle = 4;
+        for (size_t i = 0; i + shingle <= max(normalized.size(), shingle); ++i) {
+            uint64_t h = 1469598103934665603ULL;  // FNV-1a
+            for (size_t j = i; j < i + shingle && j < normalized.size(); ++j) {
+                h = (h ^ static_cast<unsigned char>(normalized[j])) * 1099511628211ULL;
+            }
+            uint32_t x = static_cast<uint32_t>(mix(h));
+            for (int k = 0; k < hashCount; ++k) {
+                uint32_t value = permutations.multipliers[k] * x + permutations.offsets[k];
+                minimums[k] = min(minimums[k], value);
+            }
+        }
+        return vector<uint32_t>(minimums, minimums + hashCount);
+    }
+
+    static uint64_t bandKey(const uint32_t* sig, int band) {
+        uint64_t h = static_cast<uint64_t>(band);
+        for (int r = 0; r < rowsPerBand; ++r) {
+            h = mix(h ^ sig[band * rowsPerBand + r]);
+        }
+        return h;
+    }
+
+    static double similarity(const uint32_t* a, const uint32_t* b) {
+        int equal = 0;
+        for (int k = 0; k < hashCount; ++k) {
+            if (a[k] == b[k]) ++equal;
+        }
+        return static_cast<double>(equal) / hashCount;
+    }
+
+    Match matchAt(int slot, double similarity) const {
+        return {ids[slot], quizIds[slot], texts[slot], similarity};
+    }
+
+    // Live slots sharing at least one band with the signature
+    vector<int> candidates(const uint32_t* sig, int self) const {
+        vector<int> slots;
+        for (int band = 0; band < bandCount; ++band) {
+            auto it = bucketHeads.find(bandKey(sig, band));
+            if (it == bucketHeads.end()) continue;
+            for (int slot = it->second; slot >= 0; slot = bucketNext[slot * bandCount + band]) {
+                if (slot != self && ids[slot] >= 0) slots.push_back(slot);
+            }
+        }
+        sort(slots.begin(), slots.end());
+        slots.erase(unique(slots.begin(), slots.end()), slots.end());
+        return slots;
+    }
+
+public:
+
+    void clear() {
+        signatures.clear();
+        ids.clear();
+        quizIds.clear();
+        texts.clear();
+        slotById.clear();
+        bucketHeads.clear();
+        bucketNext.clear();
+    }
+
+    void add(int id, int quizId, const string& text, const vector<string>& options) {
+        remove(id);
+        int slot = static_cast<int>(ids.size());
+        vector<uint32_t> sig = signature(text, options);
+        signatures.insert(signatures.end(), sig.begin(), sig.end());
+        ids.push_back(id);
+        quizIds.push_back(quizId);
+        texts.push_back(text);
+        slotById[id] = slot;
+        for (int band = 0; band < bandCount; ++band) {
+            auto inserted = bucketHeads.insert(make_pair(bandKey(sig.data(), band), slot));
+            bucketNext.push_back(inserted.second ? -1 : inserted.first->second);
+            inserted.first->second = slot;
+        }
+    }
+
+    // Removed slots stay in their buckets and are skipped on lookup
+    void remove(int id) {
+        auto it = slotById.find(id);
+        if (it == slotById.end()) return;
+        ids[it->second] = -1;
+        slotById.erase(it);
+    }
+
+    void removeQuiz(int quizId) {
+        for (size_t slot = 0; slot < ids.size(); ++slot) {
+            if (ids[slot] >= 0 && quizIds[slot] == quizId) remove(ids[slot]);
+        }
+    }
+
+    vector<Match> findSimilar(const string& text, const vector<string>& options, double threshold) const {
+        vector<uint32_t> sig = signature(text, options);
+        vector<Match> matches;
+        for (int slot : candidates(sig.data(), -1)) {
+            double estimate = similarity(sig.data(), &signatures[slot * hashCount]);
+            if (estimate >= threshold) matches.push_back(matchAt(slot, estimate));
+        }
+        sort(matches.begin(), matches.end(),
+             [](const Match& a, const Match& b) { return a.similarity > b.similarity; });
+        return matches;
+    }
+
+    // Every pair in the bank at or above the threshold, each reported once
+    vector<DuplicatePair> findAllPairs(double threshold) const {
+        vector<DuplicatePair> pairs;
+        for (size_t slot = 0; slot < ids.size(); ++slot) {
+            if (ids[slot] < 0) continue;
+            const uint32_t* sig = &signatures[slot * hashCount];
+            for (int other : candidates(sig, static_cast<int>(slot))) {
+                if (other < static_cast<int>(slot)) continue;
+                double estimate = similarity(sig, &signatures[other * hashCount]);
+                if (estimate >= threshold) {
+                    pairs.push_back({matchAt(static_cast<int>(slot), estimate), matchAt(other, estimate)});
+                }
+            }
+        }
+        return pairs;
+    }
+};
+
+// Password hashing: scrypt (RFC 7914) over PBKDF2-HMAC-SHA256. Stored
+// hashes look like $scrypt$ln=14,r=8,p=1$<salt>$<hash> with unpadded
+// base64 fields, so the cost can be raised later without breaking old rows.
+
+class Sha256 {
+private:
+    uint32_t state[8];
+    unsigned char buffer[64];
+    size_t bufferLength;
+    uint64_t totalLength;
+
+    static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+    void compress(const unsigned char* block) {
+        static const uint32_t k[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+        };
+
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = (uint32_t(block[4 * i]) << 24) | (uint32_t(block[4 * i + 1]) << 16) |
+                   (uint32_t(block[4 * i + 2]) << 8) | uint32_t(block[4 * i + 3]);
+        }
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; ++i) {
+            uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
+
+public:
+    Sha256() : bufferLength(0), totalLength(0) {
+        static const uint32_t initial[8] = {
+            0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+        };
+        copy(initial, initial + 8, state);
+    }
+
+    void update(const unsigned char* data, size_t length) {
+        totalLength += length;
+        while (length > 0) {
+            size_t take = min(length, sizeof(buffer) - bufferLength);
+            memcpy(buffer + bufferLength, data, take);
+            bufferLength += take;
+            data += take;
+            length -= take;
+            if (bufferLength == sizeof(buffer)) {
+                compress(buffer);
+                bufferLength = 0;
+            }
+        }
+    }
+
+    void finish(unsigned char digest[32]) {
+        uint64_t bits = totalLength * 8;
+        unsigned char pad = 0x80;
+        update(&pad, 1);
+        pad = 0;
+        while (bufferLength != 56) update(&pad, 1);
+        unsigned char length[8];
+        for (int i = 0; i < 8; ++i) length[i] = static_cast<unsigned char>(bits >> (56 - 8 * i));
+        update(length, 8);
+        for (int i = 0; i < 8; ++i) {
+            for (int j = 0; j < 4; ++j) digest[4 * i + j] = static_cast<unsigned char>(state[i] >> (24 - 8 * j));
+        }
+    }
+};
+
+void hmacSha256(const string& key, const unsigned char* message, size_t length, unsigned char mac[32]) {
+    unsigned char block[64] = {0};
+    if (key.size() > 64) {
+        Sha256 keyHash;
+        keyHash.update(reinterpret_cast<const unsigned char*>(key.data()), key.size());
+        keyHash.finish(block);
+    } else {
+        memcpy(block, key.data(), key.size());
+    }
+
+    unsigned char pad[64];
+    for (int i = 0; i < 64; ++i) pad[i] = block[i] ^ 0x36;
+    Sha256 inner;
+    inner.update(pad, 64);
+    inner.update(message, length);
+    unsigned char innerDigest[32];
+    inner.finish(innerDigest);
+
+    for (int i = 0; i < 64; ++i) pad[i] = block[i] ^ 0x5c;
+    Sha256 outer;
+    outer.update(pad, 64);
+    outer.update(innerDigest, 32);
+    outer.finish(mac);
+}
+
+// PBKDF2-HMAC-SHA256 with one iteration, which is all scrypt needs
+vector<unsigned char> pbkdf2Sha256(const string& password, const vector<unsigned char>& salt, size_t length) {
+    vector<unsigned char> output;
+    vector<unsigned char> message(salt);
+    message.resize(salt.size() + 4);
+    for (uint32_t blockIndex = 1; output.size() < length; ++blockIndex) {
+        for (int i = 0; i < 4; ++i) message[salt.size() + i] = static_cast<unsigned char>(blockIndex >> (24 - 8 * i));
+        unsigned char mac[32];
+        hmacSha256(password, message.data(), message.size(), mac);
+        output.insert(output.end(), mac, mac + min<size_t>(32, length - output.size()));
+    }
+    return output;
+}
+
+void salsa208(uint32_t block[16]) {
+    uint32_t x[16];
+    copy(block, block + 16, x);
+#define LINQUIZ_ROTL(a, b) (((a) << (b)) | ((a) >> (32 - (b))))
+    for (int i = 0; i < 8; i += 2) {
+        x[4] ^= LINQUIZ_ROTL(x[0] + x[12], 7);   x[8] ^= LINQUIZ_ROTL(x[4] + x[0], 9);
+        x[12] ^= LINQUIZ_ROTL(x[8] + x[4], 13);  x[0] ^= LINQUIZ_ROTL(x[12] + x[8], 18);
+        x[9] ^= LINQUIZ_ROTL(x[5] + x[1], 7);    x[13] ^= LINQUIZ_ROTL(x[9] + x[5], 9);
+        x[1] ^= LINQUIZ_ROTL(x[13] + x[9], 13);  x[5] ^= LINQUIZ_ROTL(x[1] + x[13], 18);
+        x[14] ^= LINQUIZ_ROTL(x[10] + x[6], 7);  x[2] ^= LINQUIZ_ROTL(x[14] + x[10], 9);
+        x[6] ^= LINQUIZ_ROTL(x[2] + x[14], 13);  x[10] ^= LINQUIZ_ROTL(x[6] + x[2], 18);
+        x[3] ^= LINQUIZ_ROTL(x[15] + x[11], 7);  x[7] ^= LINQUIZ_ROTL(x[3] + x[15], 9);
+        x[11] ^= LINQUIZ_ROTL(x[7] + x[3], 13);  x[15] ^= LINQUIZ_ROTL(x[11] + x[7], 18);
+        x[1] ^= LINQUIZ_ROTL(x[0] + x[3], 7);    x[2] ^= LINQUIZ_ROTL(x[1] + x[0], 9);
+        x[3] ^= LINQUIZ_ROTL(x[2] + x[1], 13);   x[0] ^= LINQUIZ_ROTL(x[3] + x[2], 18);
+        x[6] ^= LINQUIZ_ROTL(x[5] + x[4], 7);    x[7] ^= LINQUIZ_ROTL(x[6] + x[5], 9);
+        x[4] ^= LINQUIZ_ROTL(x[7] + x[6], 13);   x[5] ^= LINQUIZ_ROTL(x[4] + x[7], 18);
+        x[11] ^= LINQUIZ_ROTL(x[10] + x[9], 7);  x[8] ^= LINQUIZ_ROTL(x[11] + x[10], 9);
+        x[9] ^= LINQUIZ_ROTL(x[8] + x[11], 13);  x[10] ^= LINQUIZ_ROTL(x[9] + x[8], 18);
+        x[12] ^= LINQUIZ_ROTL(x[15] + x[14], 7); x[13] ^= LINQUIZ_ROTL(x[12] + x[15], 9);
+        x[14] ^= LINQUIZ_ROTL(x[13] + x[12], 13); x[15] ^= LINQUIZ_ROTL(x[14] + x[13], 18);
+    }
+#undef LINQUIZ_ROTL
+    for (int i = 0; i < 16; ++i) block[i] += x[i];
+}
+
+// scryptBlockMix over 2r 64-byte blocks; output goes to y
+void scryptBlockMix(const uint32_t* b, uint32_t* y, uint32_t r) {
+    uint32_t x[16];
+    copy(b + (2 * r - 1) * 16, b + 2 * r * 16, x);
+    for (uint32_t i = 0; i < 2 * r; ++i) {
+        for (int j = 0; j < 16; ++j) x[j] ^= b[i * 16 + j];
+        salsa208(x);
+        // Even blocks go to the first half of the output, odd to the second
+        copy(x, x + 16, y + ((i / 2) + (i % 2) * r) * 16);
+    }
+}
+
+// Sizes are computed in size_t; callers keep r, p and n within the limits
+// PasswordHasher::validParams allows
+vector<unsigned char> scrypt(const string& password, const vector<unsigned char>& salt,
+                             uint64_t n, uint32_t r, uint32_t p, size_t length) {
+    const size_t words = 32 * size_t(r);
+    const size_t blockBytes = 128 * size_t(r);
+    vector<unsigned char> bytes = pbkdf2Sha256(password, salt, size_t(p) * blockBytes);
+
+    vector<uint32_t> x(words), y(words), v(words * static_cast<size_t>(n));
+    for (uint32_t block = 0; block < p; ++block) {
+        unsigned char* chunk = &bytes[block * blockBytes];
+        for (size_t i = 0; i < words; ++i) {
+            x[i] = uint32_t(chunk[4 * i]) | (uint32_t(chunk[4 * i + 1]) << 8) |
+                   (uint32_t(chunk[4 * i + 2]) << 16) | (uint32_t(chunk[4 * i + 3]) << 24);
+        }
+
+        for (uint64_t i = 0; i < n; ++i) {
+            copy(x.begin(), x.end(), v.begin() + i * words);
+            scryptBlockMix(x.data(), y.data(), r);
+            x.swap(y);
+        }
+        for (uint64_t i = 0; i < n; ++i) {
+            uint64_t j = x[(2 * r - 1) * 16] & (n - 1);
+            for (size_t k = 0; k < words; ++k) x[k] ^= v[j * words + k];
+            scryptBlockMix(x.data(), y.data(), r);
+            x.swap(y);
+        }
+
+        for (size_t i = 0; i < words; ++i) {
+            for (int j = 0; j < 4; ++j) chunk[4 * i + j] = static_cast<unsigned char>(x[i] >> (8 * j));
+        }
+    }
+
+    return pbkdf2Sha256(password, bytes, length);
+}
+
+string base64Encode(const vector<unsigned char>& data) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    string out;
+    for (size_t i = 0; i < data.size(); i += 3) {
+        uint32_t chunk = uint32_t(data[i]) << 16;
+        if (i + 1 < data.size()) chunk |= uint32_t(data[i + 1]) << 8;
+        if (i + 2 < data.size()) chunk |= data[i + 2];
+        size_t chars = min<size_t>(4, (data.size() - i) * 4 / 3 + ((data.size() - i) % 3 ? 1 : 0));
+        for (size_t j = 0; j < chars; ++j) out += alphabet[(chunk >> (18 - 6 * j)) & 63];
+    }
+    return out;
+}
+
+bool base64Decode(const string& text, vector<unsigned char>& data) {
+    uint32_t chunk = 0;
+    int bits = 0;
+    for (char c : text) {
+        int value;
+        if (c >= 'A' && c <= 'Z') value = c - 'A';
+        else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+        else if (c >= '0' && c <= '9') value = c - '0' + 52;
+        else if (c == '+') value = 62;
+        else if (c == '/') value = 63;
+        else return false;
+        chunk = (chunk << 6) | value;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            data.push_back(static_cast<unsigned char>(chunk >> bits));
+        }
+    }
+    return true;
+}
+
+// Hashes and verifies passwords on a fixed set of worker threads fed by a
+// bounded queue. Callers wait on a future, so the CPU-heavy scrypt work
+// never runs on the thread that talks to the database or the user, and a
+// burst of logins queues up instead of spawning more work than there are
+// cores.
+class PasswordHasher {
+private:
+    ScryptParams params;
+    size_t queueCapacity;
+
+    mutex queueMutex;
+    condition_variable queueReady;
+    condition_variable queueSpace;
+    deque<function<void()>> queue;
+    bool stopping;
+    vector<thread> workers;
+
+    void run() {
+        while (true) {
+            function<void()> task;
+            {
+                unique_lock<mutex> lock(queueMutex);
+                queueReady.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (queue.empty()) return;
+                task = std::move(queue.front());
+                queue.pop_front();
+            }
+            queueSpace.notify_one();
+            task();
+        }
+    }
+
+    // Blocks while the queue is full
+    template <typename Result>
+    future<Result> submit(function<Result()> work) {
+        auto task = make_shared<packaged_task<Result()>>(std::move(work));
+        future<Result> result = task->get_future();
+        {
+            unique_lock<mutex> lock(queueMutex);
+            queueSpace.wait(lock, [this] { return queue.size() < queueCapacity; });
+            queue.push_back([task] { (*task)(); });
+        }
+        queueReady.notify_one();
+        return result;
+    }
+
+    static bool constantTimeEquals(const string& a, const string& b) {
+        unsigned char diff = a.size() == b.size() ? 0 : 1;
+        for (size_t i = 0; i < a.size(); ++i) {
+            diff |= a[i] ^ (i < b.size() ? b[i] : 0);
+        }
+        return diff == 0;
+    }
+
+public:
+    PasswordHasher(const ScryptParams& params, size_t threads, size_t queueCapacity)
+        : params(params), queueCapacity(queueCapacity), stopping(false) {
+        for (size_t i = 0; i < threads; ++i) {
+            workers.emplace_back(&PasswordHasher::run, this);
+        }
+    }
+
+    ~PasswordHasher() {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueReady.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    static bool isHashed(const string& stored) {
+        return stored.compare(0, 8, "$scrypt$") == 0;
+    }
+
+    // Parameters hashes are made and checked with: 2^costLog2 rounds of
+    // 128 * blockSize bytes each, at most 1 GiB, in 1 to 16 lanes. Anything
+    // outside this is refused rather than allocated.
+    static bool validParams(const ScryptParams& params) {
+        return params.costLog2 >= 1 && params.costLog2 <= 30 &&
+               params.blockSize >= 1 && params.blockSize <= 32 &&
+               params.parallelism >= 1 && params.parallelism <= 16 &&
+               (uint64_t(128) * params.blockSize << params.costLog2) <= (uint64_t(1) << 30);
+    }
+
+    // Splits a stored $scrypt$ln=N,r=N,p=N$<salt>$<hash> value. Fails on
+    // anything else, including parameters validParams refuses and salts or
+    // hashes outside 8 to 64 bytes.
+    static bool parseHash(const string& stored, ScryptParams& params, vector<unsigned char>& salt,
+                          vector<unsigned char>& key) {
+        if (!isHashed(stored)) return false;
+
+        size_t pos = 8;
+        auto number = [&](const char* name, char terminator, uint64_t& value) {
+            size_t nameLength = strlen(name);
+            if (stored.compare(pos, nameLength, name) != 0) return false;
+            pos += nameLength;
+            size_t digits = 0;
+            value = 0;
+            while (pos < stored.size() && isdigit(static_cast<unsigned char>(stored[pos])) && digits < 9) {
+                value = value * 10 + (stored[pos++] - '0');
+                ++digits;
+            }
+            if (digits == 0 || pos >= stored.size() || stored[pos] != terminator) return false;
+            ++pos;
+            return true;
+        };
+        uint64_t costLog2, blockSize, parallelism;
+        if (!number("ln=", ',', costLog2) || !number("r=", ',', blockSize) || !number("p=", '$', parallelism)) {
+            return false;
+        }
+        params = {static_cast<int>(costLog2), static_cast<uint32_t>(blockSize), static_cast<uint32_t>(parallelism)};
+        if (!validParams(params)) return false;
+
+        size_t hashStart = stored.find('$', pos);
+        if (hashStart == string::npos) return false;
+        salt.clear();
+        key.clear();
+        return base64Decode(stored.substr(pos, hashStart - pos), salt) &&
+               base64Decode(stored.substr(hashStart + 1), key) &&
+               salt.size() >= 8 && salt.size() <= 64 && key.size() >= 8 && key.size() <= 64;
+    }
+
+    // Runs on the calling thread
+    static string hashNow(const string& password, const ScryptParams& params) {
+        random_device random;
+        vector<unsigned char> salt(16);
+        for (auto& byte : salt) byte = static_cast<unsigned char>(random());
+
+        vector<unsigned char> key = scrypt(password, salt, uint64_t(1) << params.costLog2,
+                                           params.blockSize, params.parallelism, 32);
+        return "$scrypt$ln=" + to_string(params.costLog2) + ",r=" + to_string(params.blockSize) +
+               ",p=" + to_string(params.parallelism) + "$" + base64Encode(salt) + "$" + base64Encode(key);
+    }
+
+    // Runs on the calling thread. Rows that predate hashing hold the plain
+    // password and are compared directly. A malformed hash, or one whose
+    // work can't be allocated, never matches; nothing is thrown.
+    static bool verifyNow(const string& password, const string& stored) {
+        if (!isHashed(stored)) return constantTimeEquals(password, stored);
+
+        ScryptParams hashParams;
+        vector<unsigned char> salt, expected;
+        if (!parseHash(stored, hashParams, salt, expected)) return false;
+
+        try {
+            vector<unsigned char> key = scrypt(password, salt, uint64_t(1) << hashParams.costLog2,
+                                               hashParams.blockSize, hashParams.parallelism,
+                                               expected.size());
+            return constantTimeEquals(string(key.begin(), key.end()), string(expected.begin(), expected.end()));
+        } catch (const bad_alloc&) {
+            cerr << "Not enough memory to verify a password hash" << endl;
+            return false;
+        }
+    }
+
+    future<string> hash(const string& password) {
+        ScryptParams current = params;
+        return submit<string>([password, current] { return hashNow(password, current); });
+    }
+
+    future<bool> verify(const string& password, const string& stored) {
+        return submit<bool>([password, stored] { return verifyNow(password, stored); });
+    }
+};
+
+// A username as MySQL compares it: users.username has a case-insensitive
+// collation, so anything keyed by username (shard placement, throttling,
+// roster dedupe) must fold ASCII case the same way
+string foldUsername(const string& username) {
+    string folded = username;
+    transform(folded.begin(), folded.end(), folded.begin(), [](unsigned char c) { return tolower(c); });
+    return folded;
+}
+
+// Throttles login and account-deletion attempts per username and per client
+// before anything reaches the database. Each key maps to one shard holding a
+// token bucket packed into a single 64-bit word (a 16-bit key tag and the
+// time at which the bucket will next be full, in microseconds), so a check is
+// a hash, a clock read and one compare-and-swap with no lock. Shards are
+// padded to a cache line so threads checking different keys don't contend.
+// A key whose shard holds a different tag takes the shard over with a full
+// bucket; the hash is seeded per process so such collisions can't be chosen.
+class LoginRateLimiter {
+public:
+    struct Limit {
+        uint32_t burst;           // attempts allowed back to back
+        uint64_t intervalMicros;  // time to earn back one attempt
+    };
+
+private:
+    struct Shard {
+        atomic<uint64_t> state;
+        char padding[64 - sizeof(atomic<uint64_t>)];
+    };
+
+    Limit perUser;
+    Limit perClient;
+    vector<Shard> shards;
+    uint64_t seed;
+    chrono::steady_clock::time_point epoch;
+
+    uint64_t hashKey(char kind, const string& key) const {
+        uint64_t hash = seed ^ 14695981039346656037ULL;
+        hash = (hash ^ static_cast<unsigned char>(kind)) * 1099511628211ULL;
+        for (char c : key) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+        }
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        return hash ^ (hash >> 33);
+    }
+
+    bool take(char kind, const string& key, const Limit& limit, uint64_t now) {
+        const uint64_t timeMask = (uint64_t(1) << 48) - 1;
+        uint64_t hash = hashKey(kind, key);
+        Shard& shard = shards[hash & (shards.size() - 1)];
+        uint64_t tag = hash >> 48;
+        uint64_t tolerance = uint64_t(limit.burst - 1) * limit.intervalMicros;
+
+        uint64_t state = shard.state.load(memory_order_relaxed);
+        while (true) {
+            uint64_t fullAt = (state >> 48) == tag ? state & timeMask : now;
+            if (fullAt < now) fullAt = now;
+            if (fullAt - now > tolerance) return false;
+
+            uint64_t next = (tag << 48) | ((fullAt + limit.intervalMicros) & timeMask);
+            if (shard.state.compare_exchange_weak(state, next, memory_order_relaxed)) {
+                return true;
+            }
+        }
+    }
+
+public:
+    // shardCount is rounded up to a power of two
+    LoginRateLimiter(const Limit& perUser, const Limit& perClient, size_t shardCount = 4096)
+        : perUser(perUser), perClient(perClient), epoch(chrono::steady_clock::now()) {
+        size_t size = 1;
+        while (size < shardCount) size <<= 1;
+        shards = vector<Shard>(size);
+
+        random_device random;
+        seed = (uint64_t(random()) << 32) | random();
+    }
+
+    // Spends one attempt from both the user's and the client's budget. A
+    // throttled user doesn't use up the client's budget. Usernames are
+    // case-folded: MySQL matches "Admin" and "admin" to the same account,
+    // so they must share one budget.
+    bool allow(const string& username, const string& client) {
+        uint64_t now = chrono::duration_cast<chrono::microseconds>(
+            chrono::steady_clock::now() - epoch).count();
+        return take('u', foldUsername(username), perUser, now) && take('c', client, perClient, now);
+    }
+};
+
+// Leaderboard windows kept in leaderboard_buckets: days, Monday-based weeks
+// and terms of four months starting in January, May and September
+const char* const leaderboardPeriods[] = {"day", "week", "term"};
+
+// SQL for the first day of the period containing the time expression
+string periodStartSql(const string& period, const string& time) {
+    if (period == "day") return "DATE(" + time + ")";
+    if (period == "week") return "(DATE(" + time + ") - INTERVAL WEEKDAY(" + time + ") DAY)";
+    return "(MAKEDATE(YEAR(" + time + "), 1) + INTERVAL ((MONTH(" + time + ") - 1) DIV 4 * 4) MONTH)";
+}
+
+// Creates leaderboard_buckets and fills it from the attempts already
+// recorded. Each bucket holds a student's latest score per quiz within the
+// period, plus their total over all quizzes under quiz_id 0. Shared by both
+// migration lists since buckets live with the attempts.
+vector<string> leaderboardBucketStatements() {
+    vector<string> statements = {
+        "CREATE TABLE IF NOT EXISTS leaderboard_buckets ("
+        "period ENUM('day', 'week', 'term') NOT NULL,"
+        "period_start DATE NOT NULL,"
+        "quiz_id INT NOT NULL,"
+        "student_id INT NOT NULL,"
+        "score INT NOT NULL,"
+        "PRIMARY KEY (period, period_start, quiz_id, student_id),"
+        "INDEX idx_leaderboard_buckets_rank (period, period_start, quiz_id, score),"
+        "FOREIGN KEY (student_id) REFERENCES users(id) ON DELETE CASCADE)",
+
+        "ALTER TABLE student_quizzes ADD INDEX idx_student_quizzes_quiz_score (quiz_id, score)"
+    };
+    for (const char* period : leaderboardPeriods) {
+        string start = periodStartSql(period, "completed_at");
+        statements.push_back("INSERT INTO leaderboard_buckets (period, period_start, quiz_id, student_id, score) "
+                             "SELECT '" + string(period) + "', " + start + ", quiz_id, student_id, score "
+                             "FROM student_quizzes");
+        statements.push_back("INSERT INTO leaderboard_buckets (period, period_start, quiz_id, student_id, score) "
+                             "SELECT '" + string(period) + "', " + start + ", 0, student_id, SUM(score) "
+                             "FROM student_quizzes GROUP BY student_id, " + start);
+    }
+    return statements;
+}
+
+// One versioned schema change. The statements run in order and the version
+// row is recorded in the same transaction. MySQL commits DDL implicitly, so
+// a crash can leave a migration half applied. When it is retried, a
+// statement that fails because its table, column or index already exists
+// counts as done; data statements placed after the last DDL commit together
+// with the version row and simply run again. So each DDL statement makes one
+// change (a single ALTER is applied as a whole) and data statements go last.
+struct Migration {
+    int version;
+    string description;
+    vector<string> statements;
+};
+
+// Ordered schema history. Append new migrations at the end; never edit one
+// that has already shipped.
+const vector<Migration>& schemaMigrations() {
+    static const vector<Migration> migrations = {
+        {1, "Create core tables", {
+            "CREATE TABLE IF NOT EXISTS users ("
+            "id INT AUTO_INCREMENT PRIMARY KEY,"
+            "username VARCHAR(50) NOT NULL,"
+            "password VARCHAR(100) NOT NULL,"
+            "role ENUM('admin', 'student') NOT NULL,"
+            "score INT DEFAULT 0,"
+            "CONSTRAINT username_role_unique UNIQUE (username, role))",
+
+            "CREATE TABLE IF NOT EXISTS quizzes ("
+            "id INT AUTO_INCREMENT PRIMARY KEY,"
+            "title VARCHAR(100) NOT NULL,"
+            "description TEXT,"
+            "time_limit INT)",
+
+            "CREATE TABLE IF NOT EXISTS questions ("
+            "id INT AUTO_INCREMENT PRIMARY KEY,"
+            "quiz_id INT NOT NULL,"
+            "text TEXT NOT NULL,"
+            "option1 TEXT NOT NULL,"
+            "option2 TEXT NOT NULL,"
+            "option3 TEXT,"
+            "option4 TEXT,"
+            "correct_option INT NOT NULL,"
+            "FOREIGN KEY (quiz_id) REFERENCES quizzes(id) ON DELETE CASCADE)",
+
+            "CREATE TABLE IF NOT EXISTS student_quizzes ("
+            "student_id INT NOT NULL,"
+            "quiz_id INT NOT NULL,"
+            "score INT NOT NULL,"
+            "completed_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,"
+            "PRIMARY KEY (student_id, quiz_id),"
+            "FOREIGN KEY (student_id) REFERENCES users(id) ON DELETE CASCADE,"
+            "FOREIGN KEY (quiz_id) REFERENCES quizzes(id) ON DELETE CASCADE)"
+        }},
+        // Username lookups are already served by the (username, role) unique key
+        {2, "Add leaderboard index and timestamps", {
+            "ALTER TABLE users ADD INDEX idx_users_role_score (role, score, username)",
+            "ALTER TABLE users ADD COLUMN created_at TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP",
+            "ALTER TABLE quizzes "
+            "ADD COLUMN created_at TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP, "
+            "ADD COLUMN updated_at TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP ON UPDATE CURRENT_TIMESTAMP",
+            "ALTER TABLE questions ADD COLUMN created_at TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP"
+        }},
+        {3, "Widen password column for salted hashes", {
+            "ALTER TABLE users MODIFY password VARCHAR(255) NOT NULL"
+        }},
+        {4, "Track attempts applied from local journals", {
+            "CREATE TABLE IF NOT EXISTS journal_progress ("
+            "journal_id CHAR(16) PRIMARY KEY,"
+            "applied_seq BIGINT UNSIGNED NOT NULL)"
+        }},
+        // Guessing starts at one over the option count; difficulty is
+        // refit from the answer counts by the admin recalibration
+        {5, "Add item parameters for adaptive quizzes", {
+            "ALTER TABLE questions "
+            "ADD COLUMN irt_a FLOAT NOT NULL DEFAULT 1, "
+            "ADD COLUMN irt_b FLOAT NOT NULL DEFAULT 0, "
+            "ADD COLUMN irt_c FLOAT NOT NULL DEFAULT 0.25, "
+            "ADD COLUMN times_answered INT NOT NULL DEFAULT 0, "
+            "ADD COLUMN times_correct INT NOT NULL DEFAULT 0",
+            "UPDATE questions SET irt_c = 1 / (2 + (option3 IS NOT NULL) + (option4 IS NOT NULL))"
+        }},
+        // One row per quiz or question added or deleted, so other processes
+        // can update their caches; question rows carry their quiz when known
+        {6, "Log catalog changes", {
+            "CREATE TABLE IF NOT EXISTS catalog_changes ("
+            "seq BIGINT AUTO_INCREMENT PRIMARY KEY,"
+            "quiz_id INT NULL,"
+            "question_id INT NULL,"
+            "deleted BOOLEAN NOT NULL,"
+            "origin BIGINT UNSIGNED NOT NULL,"
+            "changed_at TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP,"
+            "INDEX idx_catalog_changes_changed_at (changed_at))"
+        }},
+        {7, "Add time-bucketed leaderboards", leaderboardBucketStatements()},
+        // One row per change to a student's total, for live leaderboards in
+        // other processes; kept on the student's shard
+        {8, "Log score changes", {
+            "CREATE TABLE IF NOT EXISTS score_changes ("
+            "seq BIGINT AUTO_INCREMENT PRIMARY KEY,"
+            "student_id INT NOT NULL,"
+            "old_score INT NOT NULL,"
+            "new_score INT NOT NULL,"
+            "origin BIGINT UNSIGNED NOT NULL,"
+            "changed_at TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP,"
+            "INDEX idx_score_changes_changed_at (changed_at))"
+        }},
+        // Shard count and position this database was last checked under;
+        // see DatabaseManager::checkShardLayout
+        {9, "Record the shard layout", {
+            "CREATE TABLE IF NOT EXISTS shard_layout ("
+            "id TINYINT PRIMARY KEY,"
+            "shard_count INT NOT NULL,"
+            "shard_index INT NOT NULL)"
+        }},
+        // Adaptive results are estimates, so they are kept apart from
+        // student_quizzes and never reach users.score or the leaderboards
+        {10, "Keep adaptive results separately", {
+            "CREATE TABLE IF NOT EXISTS adaptive_attempts ("
+            "student_id INT NOT NULL,"
+            "quiz_id INT NOT NULL,"
+            "ability DOUBLE NOT NULL,"
+            "expected_score DOUBLE NOT NULL,"
+            "questions_answered INT NOT NULL,"
+            "completed_at TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP,"
+            "PRIMARY KEY (student_id, quiz_id),"
+            "FOREIGN KEY (student_id) REFERENCES users(id) ON DELETE CASCADE,"
+            "FOREIGN KEY (quiz_id) REFERENCES quizzes(id) ON DELETE CASCADE)"
+        }}
+    };
+    return migrations;
+}
+
+// Schema of shards 1..N-1, which only hold users and their attempts.
+// Quizzes stay on shard 0, so attempts here carry no foreign key to them.
+// Changes to users or student_quizzes must be added to both lists.
+const vector<Migration>& shardMigrations() {
+    static const vector<Migration> migrations = {
+        {1, "Create user and attempt tables", {
+            "CREATE TABLE IF NOT EXISTS users ("
+            "id INT AUTO_INCREMENT PRIMARY KEY,"
+            "username VARCHAR(50) NOT NULL,"
+            "password VARCHAR(255) NOT NULL,"
+            "role ENUM('admin', 'student') NOT NULL,"
+            "score INT DEFAULT 0,"
+            "created_at TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP,"
+            "CONSTRAINT username_role_unique UNIQUE (username, role),"
+            "INDEX idx_users_role_score (role, score, username))",
+
+            "CREATE TABLE IF NOT EXISTS student_quizzes ("
+            "student_id INT NOT NULL,"
+            "quiz_id INT NOT NULL,"
+            "score INT NOT NULL,"
+            "completed_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,"
+            "PRIMARY KEY (student_id, quiz_id),"
+            "INDEX idx_student_quizzes_quiz (quiz_id),"
+            "FOREIGN KEY (student_id) REFERENCES users(id) ON DELETE CASCADE)"
+        }},
+        {2, "Track attempts applied from local journals", {
+            "CREATE TABLE IF NOT EXISTS journal_progress ("
+            "journal_id CHAR(16) PRIMARY KEY,"
+            "applied_seq BIGINT UNSIGNED NOT NULL)"
+        }},
+        {3, "Add time-bucketed leaderboards", leaderboardBucketStatements()},
+        {4, "Log score changes", {
+            "CREATE TABLE IF NOT EXISTS score_changes ("
+            "seq BIGINT AUTO_INCREMENT PRIMARY KEY,"
+            "student_id INT NOT NULL,"
+            "old_score INT NOT NULL,"
+            "new_score INT NOT NULL,"
+            "origin BIGINT UNSIGNED NOT NULL,"
+            "changed_at TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP,"
+            "INDEX idx_score_changes_changed_at (changed_at))"
+        }},
+        // Shard count and position this database was last checked under;
+        // see DatabaseManager::checkShardLayout
+        {5, "Record the shard layout", {
+            "CREATE TABLE IF NOT EXISTS shard_layout ("
+            "id TINYINT PRIMARY KEY,"
+            "shard_count INT NOT NULL,"
+            "shard_index INT NOT NULL)"
+        }},
+        {6, "Keep adaptive results separately", {
+            "CREATE TABLE IF NOT EXISTS adaptive_attempts ("
+            "student_id INT NOT NULL,"
+            "quiz_id INT NOT NULL,"
+            "ability DOUBLE NOT NULL,"
+            "expected_score DOUBLE NOT NULL,"
+            "questions_answered INT NOT NULL,"
+            "completed_at TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP,"
+            "PRIMARY KEY (student_id, quiz_id),"
+            "INDEX idx_adaptive_attempts_quiz (quiz_id),"
+            "FOREIGN KEY (student_id) REFERENCES users(id) ON DELETE CASCADE)"
+        }}
+    };
+    return migrations;
+}
+
+// Owns a MYSQL_RES and frees it when it goes out of scope
+struct MysqlResultDeleter {
+    void operator()(MYSQL_RES* result) const {
+        if (result) freeResult(result);
+    }
+};
+typedef unique_ptr<MYSQL_RES, MysqlResultDeleter> ResultPtr;
+
+// Typed decoding of result columns. Values are parsed in place from the
+// text and length MySQL returns, without exceptions or temporary strings.
+// NULL decodes to 0 or "", and text that isn't a whole value of the type
+// fails the decode.
+template <typename Integer>
+bool decodeInteger(const char* text, unsigned long length, Integer& value) {
+    value = 0;
+    if (!text) return true;
+
+    size_t i = 0;
+    bool negative = numeric_limits<Integer>::is_signed && length > 0 && text[0] == '-';
+    if (negative) ++i;
+    if (i == length) return false;
+
+    unsigned long long limit = numeric_limits<Integer>::max();
+    if (negative) ++limit;
+    unsigned long long magnitude = 0;
+    for (; i < length; ++i) {
+        unsigned int digit = static_cast<unsigned char>(text[i]) - '0';
+        if (digit > 9 || magnitude > (limit - digit) / 10) return false;
+        magnitude = magnitude * 10 + digit;
+    }
+    value = negative ? static_cast<Integer>(-static_cast<long long>(magnitude - 1) - 1)
+                     : static_cast<Integer>(magnitude);
+    return true;
+}
+
+bool decodeColumn(const char* text, unsigned long length, int& value) {
+    return decodeInteger(text, length, value);
+}
+
+bool decodeColumn(const char* text, unsigned long length, long long& value) {
+    return decodeInteger(text, length, value);
+}
+
+bool decodeColumn(const char* text, unsigned long length, unsigned long long& value) {
+    return decodeInteger(text, length, value);
+}
+
+// MySQL terminates every value, so strtod can parse it where it lies
+bool decodeColumn(const char* text, unsigned long length, double& value) {
+    value = 0;
+    if (!text) return true;
+    if (length == 0 || isspace(static_cast<unsigned char>(text[0]))) return false;
+    char* end;
+    errno = 0;
+    value = strtod(text, &end);
+    return end == text + length && errno != ERANGE;
+}
+
+bool decodeColumn(const char* text, unsigned long length, string& value) {
+    if (text) {
+        value.assign(text, length);
+    } else {
+        value.clear();
+    }
+    return true;
+}
+
+// A column where NULL must be told apart from 0 or ""
+template <typename T>
+struct Nullable {
+    bool present;
+    T value;
+};
+
+template <typename T>
+bool decodeColumn(const char* text, unsigned long length, Nullable<T>& column) {
+    column.present = text != nullptr;
+    return decodeColumn(text, length, column.value);
+}
+
+// Reads a result set row by row as the given column types. The number of
+// columns is fixed by the type, so next() only compiles with one variable
+// per column, and a result whose SELECT list has a different length is
+// rejected when the reader is created. Owns the result.
+template <typename... Columns>
+class RowReader {
+private:
+    static_assert(sizeof...(Columns) > 0, "a row needs at least one column");
+
+    ResultPtr result;
+    bool failed;
+
+    template <size_t... Index>
+    static bool decodeRow(MYSQL_ROW row, const unsigned long* lengths, index_sequence<Index...>,
+                          Columns&... values) {
+        bool decoded[] = {decodeColumn(row[Index], lengths[Index], values)...};
+        return all_of(begin(decoded), end(decoded), [](bool ok) { return ok; });
+    }
+
+    template <typename Row, size_t... Index>
+    static Row makeRow(tuple<Columns...>& values, index_sequence<Index...>) {
+        return Row{move(get<Index>(values))...};
+    }
+
+    template <size_t... Index>
+    bool nextInto(tuple<Columns...>& values, index_sequence<Index...>) {
+        return next(get<Index>(values)...);
+    }
+
+public:
+    explicit RowReader(MYSQL_RES* raw) : RowReader(ResultPtr(raw)) {}
+
+    explicit RowReader(ResultPtr owned) : result(move(owned)), failed(false) {
+        if (result && mysql_num_fields(result.get()) != sizeof...(Columns)) {
+            cerr << "Query returned " << mysql_num_fields(result.get()) << " columns, expected "
+                 << sizeof...(Columns) << endl;
+            failed = true;
+        }
+    }
+
+    // Decodes one row whose columns are given as text and lengths
+    static bool decode(MYSQL_ROW row, const unsigned long* lengths, Columns&... values) {
+        return decodeRow(row, lengths, index_sequence_for<Columns...>(), values...);
+    }
+
+    // Decodes the next row into values. Returns false at the end of the
+    // result and on a value that doesn't parse, after which ok() is false.
+    bool next(Columns&... values) {
+        if (failed || !result) return false;
+        MYSQL_ROW row = mysql_fetch_row(result.get());
+        if (!row) return false;
+        if (!decode(row, mysql_fetch_lengths(result.get()), values...)) {
+            cerr << "Malformed value in query result" << endl;
+            failed = true;
+            return false;
+        }
+        return true;
+    }
+
+    // Every remaining row as a Row aggregate initialized from the columns
+    // in order
+    template <typename Row>
+    vector<Row> all() {
+        vector<Row> rows;
+        tuple<Columns...> values;
+        while (nextInto(values, index_sequence_for<Columns...>())) {
+            rows.push_back(makeRow<Row>(values, index_sequence_for<Columns...>()));
+        }
+        return rows;
+    }
+
+    bool ok() const { return !failed; }
+};
+
+// id, role
+typedef RowReader<int, string> UserRoleRows;
+
+// id, text, option1, option2, option3, option4, correct_option, quiz_id
+typedef RowReader<int, string, string, string, Nullable<string>, Nullable<string>, int, int> QuestionRows;
+
+struct QuestionRow {
+    int id;
+    string text;
+    string option1;
+    string option2;
+    Nullable<string> option3;
+    Nullable<string> option4;
+    int correctOption;
+    int quizId;
+
+    Question toQuestion() const {
+        vector<string> options = {option1, option2};
+        if (option3.present) options.push_back(option3.value);
+        if (option4.present) options.push_back(option4.value);
+        return Question(id, text, options, correctOption, quizId);
+    }
+};
+
+// id, title, description, question count
+typedef RowReader<int, string, string, int> QuizRows;
+
+// Outcome of a query run through AsyncQueryExecutor
+struct AsyncResult {
+    bool ok;
+    string error;
+    ResultPtr result;  // null for statements that return no rows
+    unsigned long long affectedRows;
+};
+
+// Runs queries without blocking the caller. A few worker threads each drive
+// several connections with the MySQL non-blocking client calls, so many
+// queries are in flight at once while only a handful of threads exist. A
+// worker with nothing ready waits on its connections' sockets. A connection
+// the server dropped fails its job and is opened again, with backoff; jobs
+// fail straight away only while no worker has any connection open.
+class AsyncQueryExecutor {
+private:
+    struct Job {
+        vector<string> statements;       // run in order on one connection
+        bool transaction;                // wrapped in START TRANSACTION ... COMMIT
+        promise<AsyncResult> done;
+        function<void(bool)> completed;  // optional, runs on the worker thread
+    };
+
+    enum SlotState { Idle, Querying, Storing };
+
+    struct Slot {
+        MYSQL* conn;          // null while disconnected
+        SlotState state;
+        Job job;
+        size_t next;          // statement being run
+        bool rollingBack;     // a statement failed and ROLLBACK is under way
+        bool lost;            // the server dropped the connection
+        AsyncResult outcome;
+        chrono::steady_clock::time_point retryAt;
+        chrono::seconds retryDelay;
+    };
+
+    DbEndpoint endpoint;
+    string user;
+    string password;
+    string database;
+    size_t threadCount;
+    size_t connectionsPerThread;
+
+    mutex queueMutex;
+    condition_variable queueReady;
+    deque<Job> queue;
+    bool stopping;
+    size_t workersStarted;    // workers past their first connection attempts
+    size_t liveConnections;   // open connections over all workers
+    vector<thread> workers;
+
+    // Jobs can't run anywhere once every worker has tried and none holds a
+    // connection. Called with queueMutex held.
+    bool unreachable() const {
+        return workersStarted == threadCount && liveConnections == 0;
+    }
+
+    MYSQL* openConnection() {
+        MYSQL* handle = mysql_init(nullptr);
+        if (!handle) return nullptr;
+        if (!mysql_real_connect(handle, endpoint.host.c_str(), user.c_str(), password.c_str(),
+                                database.c_str(), endpoint.port, nullptr, 0)) {
+            cerr << "Async Connection Error: " << mysql_error(handle) << endl;
+            mysql_close(handle);
+            return nullptr;
+        }
+        return handle;
+    }
+
+    // Opens the connections that are due for another try
+    void reconnect(vector<Slot>& slots) {
+        auto now = chrono::steady_clock::now();
+        for (auto& slot : slots) {
+            if (slot.conn || now < slot.retryAt) continue;
+            slot.conn = openConnection();
+            if (!slot.conn) {
+                slot.retryAt = now + slot.retryDelay;
+                slot.retryDelay = min(slot.retryDelay * 2, chrono::seconds(30));
+                continue;
+            }
+            slot.retryDelay = chrono::seconds(1);
+            lock_guard<mutex> lock(queueMutex);
+            ++liveConnections;
+        }
+    }
+
+    // Closes a connection the server dropped; reconnect() opens it again
+    void drop(Slot& slot) {
+        mysql_close(slot.conn);
+        slot.conn = nullptr;
+        slot.lost = false;
+        slot.retryAt = chrono::steady_clock::now();
+        lock_guard<mutex> lock(queueMutex);
+        --liveConnections;
+    }
+
+    // Sleeps until one of the busy connections has something to read. The
+    // wait is capped at 5 ms so jobs queued meanwhile still start promptly.
+    static void waitForSockets(const vector<Slot>& slots) {
+        fd_set readable;
+        FD_ZERO(&readable);
+        my_socket highest = 0;
+        for (const auto& slot : slots) {
+            if (!slot.conn || slot.state == Idle) continue;
+            FD_SET(slot.conn->net.fd, &readable);
+            highest = max(highest, slot.conn->net.fd);
+        }
+        timeval timeout = {0, 5000};
+        select(static_cast<int>(highest) + 1, &readable, nullptr, nullptr, &timeout);
+    }
+
+    static void fail(Job& job, const string& error) {
+        AsyncResult outcome;
+        outcome.ok = false;
+        outcome.error = error;
+        outcome.affectedRows = 0;
+        if (job.completed) job.completed(false);
+        job.done.set_value(std::move(outcome));
+    }
+
+    static void start(Slot& slot, Job job) {
+        slot.job = std::move(job);
+        slot.next = 0;
+        slot.rollingBack = false;
+        slot.lost = false;
+        slot.outcome.ok = true;
+        slot.outcome.error.clear();
+        slot.outcome.result.reset();
+        slot.outcome.affectedRows = 0;
+        slot.state = Querying;
+    }
+
+    static void finish(Slot& slot) {
+        if (slot.job.completed) slot.job.completed(slot.outcome.ok);
+        slot.job.done.set_value(std::move(slot.outcome));
+        slot.outcome = AsyncResult();
+        slot.state = Idle;
+    }
+
+    // The first failed statement decides the outcome; inside a transaction
+    // a ROLLBACK is sent before the job finishes, unless the connection is
+    // gone and the server has rolled back already
+    static void failStatement(Slot& slot) {
+        unsigned int error = mysql_errno(slot.conn);
+        slot.lost = error == 2006 || error == 2013;  // CR_SERVER_GONE_ERROR, CR_SERVER_LOST
+        if (slot.rollingBack) {
+            finish(slot);
+            return;
+        }
+        slot.outcome.ok = false;
+        slot.outcome.error = mysql_error(slot.conn);
+        slot.outcome.result.reset();
+        slot.outcome.affectedRows = 0;
+        if (!slot.job.transaction || slot.lost) {
+            finish(slot);
+            return;
+        }
+        slot.rollingBack = true;
+        slot.job.statements = {"ROLLBACK"};
+        slot.next = 0;
+        slot.state = Querying;
+    }
+
+    // Advances one connection as far as it can go without waiting
+    static bool step(Slot& slot) {
+        if (slot.state == Querying) {
+            const string& query = slot.job.statements[slot.next];
+            net_async_status status = mysql_real_query_nonblocking(slot.conn, query.c_str(), query.length());
+            if (status == NET_ASYNC_NOT_READY) return false;
+            if (status == NET_ASYNC_ERROR) {
+                failStatement(slot);
+                return true;
+            }
+            slot.state = Storing;
+        }
+
+        MYSQL_RES* result = nullptr;
+        net_async_status status = mysql_store_result_nonblocking(slot.conn, &result);
+        if (status == NET_ASYNC_NOT_READY) return false;
+        if (status == NET_ASYNC_ERROR) {
+            failStatement(slot);
+            return true;
+        }
+        if (slot.rollingBack) {
+            if (result) mysql_free_result(result);
+            finish(slot);
+            return true;
+        }
+
+        slot.outcome.affectedRows += mysql_affected_rows(slot.conn);
+        if (result) slot.outcome.result.reset(trackResult(result));
+        if (++slot.next < slot.job.statements.size()) {
+            slot.state = Querying;
+        } else {
+            finish(slot);
+        }
+        return true;
+    }
+
+    void run() {
+        mysql_thread_init();
+
+        vector<Slot> slots(connectionsPerThread);
+        size_t connected = 0;
+        for (auto& slot : slots) {
+            slot.state = Idle;
+            slot.lost = false;
+            slot.retryDelay = chrono::seconds(1);
+            slot.retryAt = chrono::steady_clock::now() + slot.retryDelay;
+            slot.conn = openConnection();
+            if (slot.conn) ++connected;
+        }
+        {
+            lock_guard<mutex> lock(queueMutex);
+            liveConnections += connected;
+            ++workersStarted;
+        }
+
+        while (true) {
+            reconnect(slots);
+
+            size_t busy = 0, live = 0;
+            {
+                unique_lock<mutex> lock(queueMutex);
+
+                // Without a single working connection anywhere every job fails fast
+                if (unreachable()) {
+                    for (auto& job : queue) {
+                        fail(job, "No async connection available");
+                    }
+                    queue.clear();
+                }
+
+                for (auto& slot : slots) {
+                    if (!slot.conn) continue;
+                    ++live;
+                    if (slot.state == Idle && !queue.empty()) {
+                        start(slot, std::move(queue.front()));
+                        queue.pop_front();
+                    }
+                    if (slot.state != Idle) ++busy;
+                }
+
+                if (busy == 0) {
+                    if (stopping) break;
+                    if (live < slots.size()) {
+                        // Wake for the next reconnect; without a connection
+                        // queued jobs are left to the other workers
+                        queueReady.wait_for(lock, chrono::seconds(1),
+                                            [this, live] { return stopping || (live > 0 && !queue.empty()); });
+                    } else {
+                        queueReady.wait(lock, [this] { return stopping || !queue.empty(); });
+                    }
+                    continue;
+                }
+            }
+
+            bool progressed = false;
+            for (auto& slot : slots) {
+                if (slot.state != Idle && step(slot)) progressed = true;
+                if (slot.lost) drop(slot);
+            }
+
+            if (!progressed) {
+                waitForSockets(slots);
+            }
+        }
+
+        for (auto& slot : slots) {
+            if (slot.conn) mysql_close(slot.conn);
+        }
+        mysql_thread_end();
+    }
+
+public:
+    AsyncQueryExecutor(const DbEndpoint& endpoint, const string& user, const string& password,
+                       const string& database, size_t threads, size_t connectionsPerThread)
+        : endpoint(endpoint), user(user), password(password), database(database), threadCount(threads),
+          connectionsPerThread(connectionsPerThread), stopping(false), workersStarted(0), liveConnections(0) {
+        for (size_t i = 0; i < threads; ++i) {
+            workers.emplace_back(&AsyncQueryExecutor::run, this);
+        }
+    }
+
+    ~AsyncQueryExecutor() {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueReady.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        // Jobs submitted after the workers exited are failed explicitly
+        for (auto& job : queue) {
+            fail(job, "Async executor stopped");
+        }
+    }
+
+    future<AsyncResult> submit(const string& query, function<void(bool)> completed = nullptr) {
+        return enqueue({query}, false, std::move(completed));
+    }
+
+    // Runs statements in order as one transaction on a single connection.
+    // The result is that of the first failed statement, after which the
+    // transaction is rolled back, or else the last result set and the rows
+    // affected by all statements together.
+    future<AsyncResult> submitTransaction(const vector<string>& statements, function<void(bool)> completed = nullptr) {
+        vector<string> wrapped;
+        wrapped.push_back("START TRANSACTION");
+        wrapped.insert(wrapped.end(), statements.begin(), statements.end());
+        wrapped.push_back("COMMIT");
+        return enqueue(std::move(wrapped), true, std::move(completed));
+    }
+
+private:
+    future<AsyncResult> enqueue(vector<string> statements, bool transaction, function<void(bool)> completed) {
+        Job job;
+        job.statements = std::move(statements);
+        job.transaction = transaction;
+        job.completed = std::move(completed);
+        future<AsyncResult> result = job.done.get_future();
+        {
+            lock_guard<mutex> lock(queueMutex);
+            if (!unreachable()) {
+                queue.push_back(std::move(job));
+                queueReady.notify_one();
+                return result;
+            }
+        }
+        fail(job, "No async connection available");
+        return result;
+    }
+};
+
+// Where a traced statement was sent
+enum TraceTarget { TracePrimary, TraceReplica, TraceAsyncRead, TraceAsyncWrite };
+
+// One statement from a trace file
+struct TraceRecord {
+    uint64_t startedAt;       // microseconds since the Unix epoch
+    uint64_t durationMicros;
+    uint64_t session;
+    int target;
+    bool failed;
+    string operation;
+    string sql;
+};
+
+uint64_t microsSinceEpoch() {
+    return chrono::duration_cast<chrono::microseconds>(
+        chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Trace file layout: the magic "LQTRACE1" followed by one record per
+// statement. Every integer is a LEB128 varint:
+//   start time as a zigzag delta from the previous record, duration,
+//   session, flags (target | failed << 2), operation number, then the
+//   operation name (length, bytes) only the first time its number appears,
+//   and finally the SQL (length, bytes).
+// Records are appended as statements finish, so start times are only
+// roughly ordered; readers sort them.
+class QueryTraceWriter {
+private:
+    ofstream out;
+    mutex writeMutex;
+    string buffer;
+    uint64_t lastStart;
+    unordered_map<string, uint64_t> operations;
+
+    static void putVarint(string& data, uint64_t value) {
+        while (value >= 0x80) {
+            data += static_cast<char>((value & 0x7f) | 0x80);
+            value >>= 7;
+        }
+        data += static_cast<char>(value);
+    }
+
+    void flush() {
+        out.write(buffer.data(), buffer.size());
+        out.flush();
+        buffer.clear();
+    }
+
+public:
+    QueryTraceWriter() : lastStart(0) {}
+
+    ~QueryTraceWriter() {
+        if (out.is_open()) flush();
+    }
+
+    bool open(const string& path) {
+        out.open(path.c_str(), ios::binary | ios::trunc);
+        if (!out) return false;
+        out.write("LQTRACE1", 8);
+        return true;
+    }
+
+    // Password hashes are replaced with a fixed placeholder so traces can be
+    // shared without them
+    void record(uint64_t startedAt, uint64_t durationMicros, uint64_t session, int target,
+                bool failed, const char* operation, const char* sql) {
+        string statement = sql;
+        size_t hashAt = 0;
+        while ((hashAt = statement.find("$scrypt$", hashAt)) != string::npos) {
+            size_t end = statement.find('\'', hashAt);
+            if (end == string::npos) end = statement.size();
+            statement.replace(hashAt, end - hashAt, "$scrypt$redacted");
+            hashAt += 16;
+        }
+
+        lock_guard<mutex> lock(writeMutex);
+        int64_t delta = static_cast<int64_t>(startedAt - lastStart);
+        lastStart = startedAt;
+        putVarint(buffer, (static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63));
+        putVarint(buffer, durationMicros);
+        putVarint(buffer, session);
+        putVarint(buffer, static_cast<uint64_t>(target) | (failed ? 4 : 0));
+
+        auto known = operations.find(operation);
+        if (known != operations.end()) {
+            putVarint(buffer, known->second);
+        } else {
+            uint64_t number = operations.size();
+            operations[operation] = number;
+            putVarint(buffer, number);
+            putVarint(buffer, strlen(operation));
+            buffer += operation;
+        }
+
+        putVarint(buffer, statement.size());
+        buffer += statement;
+
+        if (buffer.size() >= 64 * 1024) flush();
+    }
+};
+
+// Appends every record of a trace file; false if it is missing or corrupt
+bool readTrace(const string& path, vector<TraceRecord>& records) {
+    ifstream in(path.c_str(), ios::binary);
+    string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    if (data.compare(0, 8, "LQTRACE1") != 0) {
+        cerr << path << ": not a trace file" << endl;
+        return false;
+    }
+
+    size_t pos = 8;
+    bool ok = true;
+    auto varint = [&]() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (pos >= data.size()) break;
+            unsigned char byte = data[pos++];
+            value |= uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        ok = false;
+        return uint64_t(0);
+    };
+    auto bytes = [&]() {
+        uint64_t length = varint();
+        if (!ok || length > data.size() - pos) {
+            ok = false;
+            return string();
+        }
+        pos += length;
+        return data.substr(pos - length, length);
+    };
+
+    vector<string> operations;
+    uint64_t start = 0;
+    while (ok && pos < data.size()) {
+        TraceRecord record;
+        uint64_t delta = varint();
+        start += static_cast<uint64_t>(static_cast<int64_t>(delta >> 1) ^ -static_cast<int64_t>(delta & 1));
+        record.startedAt = start;
+        record.durationMicros = varint();
+        record.session = varint();
+        uint64_t flags = varint();
+        record.target = static_cast<int>(flags & 3);
+        record.failed = (flags & 4) != 0;
+
+        uint64_t number = varint();
+        if (number == operations.size()) {
+            operations.push_back(bytes());
+        } else if (number > operations.size()) {
+            ok = false;
+        }
+        if (!ok) break;
+        record.operation = operations[number];
+        record.sql = bytes();
+        if (ok) records.push_back(std::move(record));
+    }
+
+    if (!ok) {
+        cerr << path << ": trace is truncated or corrupt after " << records.size() << " records" << endl;
+    }
+    return ok;
+}
+
+// A quiz attempt waiting in the journal
+struct JournaledAttempt {
+    uint64_t seq;
+    int studentId;
+    int quizId;
+    int score;
+    int64_t submittedAt;  // microseconds since the Unix epoch
+};
+
+uint32_t crc32(const unsigned char* data, size_t length) {
+    static uint32_t table[256];
+    static bool ready = [] {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        return true;
+    }();
+    (void)ready;
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; ++i) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+// Local write-ahead journal for quiz attempts. append() returns once the
+// attempt is on disk, so a student's result survives MySQL being slow or
+// down. A committer thread writes whatever has queued up since its last
+// write and syncs it once (group commit); a drainer thread hands durable
+// attempts in order to the apply callback, retrying with backoff until it
+// succeeds. The callback must be idempotent per (journal ID, seq), since
+// after a restart everything still in the file is handed over again.
+//
+// File layout: the magic "LQJRNL1" and a NUL, a 16-character journal ID,
+// then records of [payload length u32][CRC-32 of payload u32][payload:
+// seq u64, student u32, quiz u32, score u32, submitted u64], little endian.
+// A torn or corrupt tail is cut off on open. Once everything has been
+// applied and the file has grown past 1 MiB it is replaced by an empty one
+// with a new ID, so sequence numbers never repeat under one ID. After a
+// failed write the file is cut back to its last good record and reopened
+// before the next batch; only the attempts in the failed batch are lost.
+class AttemptJournal {
+public:
+    typedef function<bool(const string& journalId, const vector<JournaledAttempt>& batch)> ApplyBatch;
+
+private:
+    static const size_t payloadSize = 28;
+
+    string path;
+    ApplyBatch apply;
+    FILE* file;
+    string journalId;
+    size_t fileBytes;
+
+    mutex stateMutex;
+    condition_variable writeReady;    // committer: something to write
+    condition_variable durable;       // appenders: their record is synced
+    condition_variable drainReady;    // drainer: something to apply
+    string pendingBytes;
+    vector<JournaledAttempt> pendingRecords;
+    bool writing;
+    uint64_t nextSeq;
+    uint64_t durableSeq;
+    set<uint64_t> lostSeqs;  // records whose batch failed to write, until their appender sees it
+    deque<JournaledAttempt> unapplied;
+    bool stopping;
+    thread committer;
+    thread drainer;
+
+    static void encode(const JournaledAttempt& attempt, string& out) {
+        unsigned char payload[payloadSize];
+        uint32_t studentId = attempt.studentId, quizId = attempt.quizId, score = attempt.score;
+        memcpy(payload, &attempt.seq, 8);
+        memcpy(payload + 8, &studentId, 4);
+        memcpy(payload + 12, &quizId, 4);
+        memcpy(payload + 16, &score, 4);
+        memcpy(payload + 20, &attempt.submittedAt, 8);
+
+        uint32_t length = payloadSize, checksum = crc32(payload, payloadSize);
+        out.append(reinterpret_cast<const char*>(&length), 4);
+        out.append(reinterpret_cast<const char*>(&checksum), 4);
+        out.append(reinterpret_cast<const char*>(payload), payloadSize);
+    }
+
+    static bool syncFile(FILE* handle) {
+        return fflush(handle) == 0 && _commit(_fileno(handle)) == 0;
+    }
+
+    // Starts an empty journal file under a fresh ID. Sequence numbers carry
+    // on from the old file; they only have to be unique under one ID.
+    bool createFile() {
+        random_device random;
+        char id[17];
+        snprintf(id, sizeof(id), "%08x%08x", random(), random());
+        journalId = id;
+        fileBytes = 0;
+
+        file = _fsopen(path.c_str(), "wb", _SH_DENYWR);
+        if (!file) return false;
+        string header("LQJRNL1\0", 8);
+        header += journalId;
+        if (fwrite(header.data(), 1, header.size(), file) != header.size() || !syncFile(file)) {
+            fclose(file);
+            file = nullptr;
+            return false;
+        }
+        fileBytes = header.size();
+        return true;
+    }
+
+    // Opens the file again after a failed write, cutting off whatever part
+    // of the failed batch reached it. If there is no usable file left (a
+    // failed rotation) and nothing is waiting to be applied, starts a new one.
+    bool reopen() {
+        if (fileBytes > 0) {
+            file = _fsopen(path.c_str(), "r+b", _SH_DENYWR);
+            if (!file) {
+                if (errno != ENOENT) return false;
+            } else if (_chsize_s(_fileno(file), fileBytes) == 0 && fseek(file, 0, SEEK_END) == 0) {
+                return true;
+            } else {
+                fclose(file);
+                file = nullptr;
+                return false;
+            }
+        }
+        return unapplied.empty() && createFile();
+    }
+
+    // Reads back a journal left by an earlier run
+    bool recover() {
+        ifstream in(path.c_str(), ios::binary);
+        if (!in) return createFile();
+        string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        in.close();
+        if (data.size() < 24 || data.compare(0, 8, string("LQJRNL1\0", 8)) != 0) {
+            cerr << "Journal " << path << " is not an attempt journal" << endl;
+            return false;
+        }
+        journalId = data.substr(8, 16);
+
+        size_t pos = 24;
+        uint64_t lastSeq = 0;
+        while (pos + 8 + payloadSize <= data.size()) {
+            uint32_t length, checksum;
+            memcpy(&length, data.data() + pos, 4);
+            memcpy(&checksum, data.data() + pos + 4, 4);
+            const unsigned char* payload = reinterpret_cast<const unsigned char*>(data.data() + pos + 8);
+            if (length != payloadSize || crc32(payload, payloadSize) != checksum) break;
+
+            JournaledAttempt attempt;
+            uint32_t studentId, quizId, score;
+            memcpy(&attempt.seq, payload, 8);
+            memcpy(&studentId, payload + 8, 4);
+            memcpy(&quizId, payload + 12, 4);
+            memcpy(&score, payload + 16, 4);
+            memcpy(&attempt.submittedAt, payload + 20, 8);
+            attempt.studentId = studentId;
+            attempt.quizId = quizId;
+            attempt.score = score;
+            unapplied.push_back(attempt);
+            lastSeq = attempt.seq;
+            pos += 8 + payloadSize;
+        }
+
+        // Drop a torn tail by rewriting the good prefix through a temp file
+        if (pos < data.size()) {
+            cerr << "Journal " << path << ": discarding " << data.size() - pos << " damaged trailing bytes" << endl;
+            string temp = path + ".tmp";
+            FILE* out = fopen(temp.c_str(), "wb");
+            bool ok = out && fwrite(data.data(), 1, pos, out) == pos && syncFile(out);
+            if (out) fclose(out);
+            if (!ok || remove(path.c_str()) != 0 || rename(temp.c_str(), path.c_str()) != 0) {
+                cerr << "Cannot repair journal " << path << endl;
+                return false;
+            }
+        }
+
+        file = _fsopen(path.c_str(), "ab", _SH_DENYWR);
+        if (!file) return false;
+        fileBytes = pos;
+        nextSeq = lastSeq + 1;
+        if (!unapplied.empty()) {
+            cout << "Replaying " << unapplied.size() << " journaled quiz attempt(s).\n";
+        }
+        return true;
+    }
+
+    void runCommitter() {
+        unique_lock<mutex> lock(stateMutex);
+        while (true) {
+            writeReady.wait(lock, [this] { return stopping || !pendingBytes.empty(); });
+            if (pendingBytes.empty()) return;
+
+            string bytes;
+            vector<JournaledAttempt> records;
+            bytes.swap(pendingBytes);
+            records.swap(pendingRecords);
+            writing = true;
+            if (!file && reopen()) {
+                cerr << "Journal " << path << " reopened" << endl;
+            }
+            FILE* handle = file;
+            lock.unlock();
+
+            bool ok = handle && fwrite(bytes.data(), 1, bytes.size(), handle) == bytes.size() &&
+                      syncFile(handle);
+
+            lock.lock();
+            writing = false;
+            if (ok) {
+                fileBytes += bytes.size();
+                unapplied.insert(unapplied.end(), records.begin(), records.end());
+                drainReady.notify_one();
+            } else {
+                // A partial write can't be appended after; the next batch reopens
+                if (handle) {
+                    cerr << "Journal write failed: " << strerror(errno) << endl;
+                    fclose(file);
+                    file = nullptr;
+                }
+                for (const auto& record : records) lostSeqs.insert(record.seq);
+            }
+            durableSeq = records.back().seq;
+            durable.notify_all();
+        }
+    }
+
+    void runDrainer() {
+        chrono::seconds backoff(1);
+        unique_lock<mutex> lock(stateMutex);
+        while (true) {
+            drainReady.wait(lock, [this] { return stopping || !unapplied.empty(); });
+            if (stopping) return;
+
+            size_t count = min<size_t>(unapplied.size(), 100);
+            vector<JournaledAttempt> batch(unapplied.begin(), unapplied.begin() + count);
+            string id = journalId;
+            lock.unlock();
+
+            bool ok = apply(id, batch);
+
+            lock.lock();
+            if (!ok) {
+                drainReady.wait_for(lock, backoff, [this] { return stopping; });
+                backoff = min(backoff * 2, chrono::seconds(30));
+                continue;
+            }
+            backoff = chrono::seconds(1);
+            unapplied.erase(unapplied.begin(), unapplied.begin() + count);
+
+            if (unapplied.empty() && pendingBytes.empty() && !writing && file && fileBytes > (1 << 20)) {
+                fclose(file);
+                file = nullptr;
+                if (remove(path.c_str()) != 0 || !createFile()) {
+                    cerr << "Cannot start a new journal at " << path << endl;
+                }
+            }
+        }
+    }
+
+public:
+    AttemptJournal(const string& path, ApplyBatch apply)
+        : path(path), apply(std::move(apply)), file(nullptr), fileBytes(0), writing(false),
+          nextSeq(1), durableSeq(0), stopping(false) {}
+
+    ~AttemptJournal() {
+        {
+            lock_guard<mutex> lock(stateMutex);
+            stopping = true;
+        }
+        writeReady.notify_all();
+        drainReady.notify_all();
+        if (committer.joinable()) committer.join();
+        if (drainer.joinable()) drainer.join();
+        if (file) fclose(file);
+    }
+
+    // Recovers or creates the file and starts both threads. Fails if the
+    // file is damaged beyond its tail or another process has it open.
+    bool open() {
+        if (!recover()) return false;
+        durableSeq = nextSeq - 1;
+        committer = thread(&AttemptJournal::runCommitter, this);
+        drainer = thread(&AttemptJournal::runDrainer, this);
+        return true;
+    }
+
+    // Blocks until the attempt is on disk; returns false if it couldn't be
+    // written, in which case nothing was journaled
+    bool append(int studentId, int quizId, int score) {
+        unique_lock<mutex> lock(stateMutex);
+
+        JournaledAttempt attempt = {nextSeq++, studentId, quizId, score,
+                                    static_cast<int64_t>(microsSinceEpoch())};
+        encode(attempt, pendingBytes);
+        pendingRecords.push_back(attempt);
+        writeReady.notify_one();
+
+        durable.wait(lock, [this, &attempt] { return durableSeq >= attempt.seq; });
+        return lostSeqs.erase(attempt.seq) == 0;
+    }
+
+    // Attempts by this student that are journaled but not yet in MySQL
+    size_t pendingFor(int studentId) {
+        lock_guard<mutex> lock(stateMutex);
+        size_t count = 0;
+        for (const auto& attempt : unapplied) {
+            if (attempt.studentId == studentId) ++count;
+        }
+        return count;
+    }
+};
+
+// A change to a student's total score
+struct ScoreChange {
+    int studentId;
+    int oldScore;
+    int newScore;
+};
+
+// One row of a leaderboard
+struct LeaderboardEntry {
+    int id;
+    string username;
+    int score;
+};
+
+// Publish/subscribe for score changes within this process. publish() never
+// waits for subscribers: changes queue up and a dispatcher thread hands them
+// out in batches, one batch interval after the first change arrives, with
+// every change to a student since the last batch folded into one (first old
+// score, latest new score). Nothing is queued while nobody is subscribed.
+// Subscribers run on the dispatcher thread, must not block and must not
+// unsubscribe themselves; once unsubscribe() returns the subscriber is not
+// running and is not called again.
+class ScoreFeed {
+public:
+    typedef function<void(const vector<ScoreChange>& batch)> Subscriber;
+
+private:
+    chrono::milliseconds batchInterval;
+    uint64_t feedOrigin;
+
+    mutex stateMutex;
+    condition_variable changed;
+    map<int, ScoreChange> pending;  // by student
+    map<uint64_t, Subscriber> subscribers;
+    uint64_t nextSubscription;
+    bool stopping;
+    mutex deliveryMutex;  // held while subscribers run
+    thread dispatcher;
+
+    void runDispatcher() {
+        unique_lock<mutex> lock(stateMutex);
+        while (true) {
+            changed.wait(lock, [this] { return stopping || !pending.empty(); });
+            if (stopping) return;
+            changed.wait_for(lock, batchInterval, [this] { return stopping; });
+            if (stopping) return;
+
+            vector<ScoreChange> batch;
+            for (const auto& entry : pending) {
+                if (entry.second.oldScore != entry.second.newScore) batch.push_back(entry.second);
+            }
+            pending.clear();
+            if (batch.empty()) continue;
+
+            // Taken before the state lock is released, so a subscriber
+            // removed after this point is waited for rather than called late
+            unique_lock<mutex> delivering(deliveryMutex);
+            vector<Subscriber> receivers;
+            for (const auto& entry : subscribers) {
+                receivers.push_back(entry.second);
+            }
+            lock.unlock();
+            for (const auto& receiver : receivers) {
+                receiver(batch);
+            }
+            delivering.unlock();
+            lock.lock();
+        }
+    }
+
+public:
+    explicit ScoreFeed(chrono::milliseconds batchInterval = chrono::milliseconds(250))
+        : batchInterval(batchInterval), feedOrigin(0), nextSubscription(1), stopping(false) {
+        random_device random;
+        feedOrigin = (uint64_t(random()) << 32) | random();
+        dispatcher = thread(&ScoreFeed::runDispatcher, this);
+    }
+
+    ~ScoreFeed() {
+        {
+            lock_guard<mutex> lock(stateMutex);
+            stopping = true;
+        }
+        changed.notify_all();
+        dispatcher.join();
+    }
+
+    // Tags the score_changes rows written by this process, which its own
+    // subscribers have already been sent
+    uint64_t origin() const { return feedOrigin; }
+
+    void publish(const ScoreChange& change) {
+        {
+            lock_guard<mutex> lock(stateMutex);
+            if (subscribers.empty()) return;
+            auto queued = pending.insert({change.studentId, change});
+            if (!queued.second) queued.first->second.newScore = change.newScore;
+        }
+        changed.notify_one();
+    }
+
+    uint64_t subscribe(Subscriber subscriber) {
+        lock_guard<mutex> lock(stateMutex);
+        subscribers[nextSubscription] = std::move(subscriber);
+        return nextSubscription++;
+    }
+
+    // Whether anyone is subscribed
+    bool watched() {
+        lock_guard<mutex> lock(stateMutex);
+        return !subscribers.empty();
+    }
+
+    void unsubscribe(uint64_t subscription) {
+        {
+            lock_guard<mutex> lock(stateMutex);
+            subscribers.erase(subscription);
+        }
+        lock_guard<mutex> waitForDelivery(deliveryMutex);
+    }
+};
+
+// One account from a roster file
+struct RosterEntry {
+    int line;
+    string username;
+    string password;
+    string role;
+};
+
+// Parses "username,password" or "username,password,role" with surrounding
+// spaces trimmed; role defaults to student. The username ends at the first
+// comma and a role, if any, follows the last one, so passwords (and stored
+// $scrypt$ hashes) may contain commas. A password starting with $scrypt$
+// is taken as a stored hash and must parse as one that can be verified.
+// Blank lines and lines starting with # leave username empty. Returns what
+// is wrong with a malformed line, or "" if it parsed.
+string parseRosterLine(const string& text, RosterEntry& entry) {
+    auto trim = [](const string& field) {
+        size_t first = field.find_first_not_of(" \t\r\n");
+        size_t last = field.find_last_not_of(" \t\r\n");
+        return first == string::npos ? string() : field.substr(first, last - first + 1);
+    };
+
+    entry.username.clear();
+    string line = trim(text);
+    if (line.empty() || line[0] == '#') return "";
+
+    size_t comma = line.find(',');
+    if (comma == string::npos) return "expected username,password[,role]";
+    string username = trim(line.substr(0, comma));
+    string password = trim(line.substr(comma + 1));
+    string role = "student";
+
+    size_t last = password.rfind(',');
+    if (last != string::npos) {
+        string suffix = trim(password.substr(last + 1));
+        transform(suffix.begin(), suffix.end(), suffix.begin(), [](unsigned char c) { return tolower(c); });
+        if (suffix == "student" || suffix == "admin") {
+            role = suffix;
+            password = trim(password.substr(0, last));
+        }
+    }
+
+    // users.username is VARCHAR(50): count characters, not UTF-8 bytes
+    size_t characters = count_if(username.begin(), username.end(),
+                                 [](unsigned char c) { return (c & 0xC0) != 0x80; });
+    if (characters == 0 || characters > 50) return "username must be 1 to 50 characters";
+    if (password.empty()) return "missing password";
+
+    ScryptParams params;
+    vector<unsigned char> salt, key;
+    if (PasswordHasher::isHashed(password) && !PasswordHasher::parseHash(password, params, salt, key)) {
+        return "password starts with $scrypt$ but is not a valid hash (ln 1-30, r 1-32, p 1-16, "
+               "at most 1 GiB, salt and hash 8 to 64 bytes)";
+    }
+
+    entry.username = username;
+    entry.password = password;
+    entry.role = role;
+    return "";
+}
+
+// Key for telling roster accounts apart: usernames compare without regard
+// to ASCII case, as the users table's collation does
+string rosterKey(const string& username, const string& role) {
+    return role + "\n" + foldUsername(username);
+}
+
+// Cleared by background threads whose statements stay out of the trace
+thread_local bool traceThisThread = true;
+
+// Database Manager class
+// DatabaseManager handles all MySQL interactions
+class DatabaseManager {
+private:
+    MYSQL* conn;                  // Primary: every write and read-your-writes reads
+    vector<MYSQL*> replicaConns;  // Read replicas, used round-robin
+    // Shard 0 is conn. Users and their attempts live on the shard picked by
+    // hashing the username; IDs are handed out so that (id - 1) % N is that
+    // shard, which lets anything keyed by student ID be routed without a lookup.
+    vector<MYSQL*> shardConns;
+    size_t nextReplica;
+    DatabaseConfig config;
+    bool hasWritten;
+    chrono::steady_clock::time_point lastWriteAt;
+    unique_ptr<AsyncQueryExecutor> asyncReads;
+    unique_ptr<AsyncQueryExecutor> asyncWrites;
+    // In-memory indexes over the question bank. Built together on first use
+    // and kept current by the mutation methods; bankIndexesReady is cleared
+    // when a change can't be applied incrementally.
+    SearchIndex searchIndex;
+    NearDuplicateDetector duplicateDetector;
+    bool bankIndexesReady;
+    unique_ptr<PasswordHasher> passwordHasher;
+    // Statement trace, only when DatabaseConfig::tracePath is set
+    unique_ptr<QueryTraceWriter> trace;
+    uint64_t sessionId;
+    // Attempt journal and its drainer thread's own connections, one per
+    // shard; only the drainer thread touches them once the journal is open
+    vector<MYSQL*> drainConns;
+    unique_ptr<AttemptJournal> journal;
+    // Quizzes students have opened, filled on first use and updated by the
+    // mutation methods below
+    CatalogStore catalog;
+    // Position in catalog_changes: every change up to catalogWatermark is
+    // applied, as are those above it in catalogApplied. catalogOrigin tags
+    // this process's own changes, which it has already applied.
+    uint64_t catalogWatermark;
+    set<uint64_t> catalogApplied;
+    uint64_t catalogOrigin;
+    chrono::steady_clock::time_point lastCatalogSync;
+    // Score changes made here, plus those other processes logged in
+    // score_changes, which one poller thread per process reads while the
+    // feed has subscribers, on its own connections (opened on first use,
+    // not traced). Per shard, every row up to its watermark has been
+    // published, as have those above it in scoreSeen; only the poller
+    // touches these.
+    shared_ptr<ScoreFeed> scores;
+    vector<MYSQL*> pollConns;
+    vector<unsigned long long> scoreWatermarks;
+    vector<set<unsigned long long>> scoreSeen;
+    chrono::steady_clock::time_point lastScoreSync;
+    mutex pollerMutex;
+    condition_variable pollerWake;
+    bool pollerStopping;
+    thread scorePoller;
+
+    MYSQL* connect(const DbEndpoint& endpoint) {
+        MYSQL* handle = mysql_init(nullptr);
+        if (!handle) {
+            return nullptr;
+        }
+
+        if (!mysql_real_connect(handle, endpoint.host.c_str(), config.user.c_str(),
+                              config.password.c_str(), config.database.c_str(),
+                              endpoint.port, nullptr, 0)) {
+            cerr << "Connection Error (" << endpoint.host << "): " << mysql_error(handle) << endl;
+            mysql_close(handle);
+            return nullptr;
+        }
+        return handle;
+    }
+
+    // Every statement goes through here so it can be traced. operation names
+    // the DatabaseManager method that issued it.
+    int runQuery(MYSQL* handle, const char* sql, const char* operation) {
+        MemoryTagScope scope(TagQueries);
+        if (!trace || !traceThisThread) return mysql_query(handle, sql);
+
+        uint64_t startedAt = microsSinceEpoch();
+        auto start = chrono::steady_clock::now();
+        int status = mysql_query(handle, sql);
+        uint64_t duration = chrono::duration_cast<chrono::microseconds>(
+            chrono::steady_clock::now() - start).count();
+        bool replica = find(replicaConns.begin(), replicaConns.end(), handle) != replicaConns.end();
+        trace->record(startedAt, duration, sessionId, replica ? TraceReplica : TracePrimary,
+                      status != 0, operation, sql);
+        return status;
+    }
+
+    // Completion hook that traces a statement run by an AsyncQueryExecutor
+    function<void(bool)> traceAsync(int target, const char* operation, const string& query) {
+        if (!trace) return nullptr;
+
+        QueryTraceWriter* writer = trace.get();
+        uint64_t session = sessionId;
+        uint64_t startedAt = microsSinceEpoch();
+        auto start = chrono::steady_clock::now();
+        return [writer, session, target, operation, query, startedAt, start](bool ok) {
+            uint64_t duration = chrono::duration_cast<chrono::microseconds>(
+                chrono::steady_clock::now() - start).count();
+            writer->record(startedAt, duration, session, target, !ok, operation, query.c_str());
+        };
+    }
+
+    // Called before every write so that later reads stick to the primary
+    void noteWrite() {
+        hasWritten = true;
+        lastWriteAt = chrono::steady_clock::now();
+    }
+
+    MYSQL* readConnection() {
+        if (replicaConns.empty()) return conn;
+
+        if (hasWritten && chrono::steady_clock::now() - lastWriteAt <
+                          chrono::seconds(config.readYourWritesSeconds)) {
+            return conn;
+        }
+
+        MYSQL* replica = replicaConns[nextReplica];
+        nextReplica = (nextReplica + 1) % replicaConns.size();
+        return replica;
+    }
+
+    size_t shardOfUser(int userId) const {
+        return static_cast<size_t>(userId - 1) % shardConns.size();
+    }
+
+    // Hashes the case-folded name, so every spelling MySQL treats as the
+    // same user lands on the shard whose unique key can reject it
+    size_t shardOfUsername(const string& username) const {
+        uint32_t hash = 2166136261u;  // FNV-1a
+        for (char c : foldUsername(username)) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+        }
+        return hash % shardConns.size();
+    }
+
+    // Runs an INSERT INTO users on a shard. With N shards, user IDs inserted
+    // through shard k are k+1, k+1+N, ..., which lets anything keyed by user
+    // ID be routed without a lookup. The step is set right before the insert
+    // and undone after it, so other tables keep consecutive IDs and a
+    // reconnected session can't have lost it. Returns 0 or the MySQL error
+    // number; errors other than ER_DUP_ENTRY are reported here.
+    unsigned int insertUsers(size_t shard, const string& query, const char* operation) {
+        MYSQL* handle = shardConns[shard];
+        noteWrite();
+        if (shardConns.size() > 1) {
+            string step = "SET SESSION auto_increment_increment = " + to_string(shardConns.size()) +
+                         ", auto_increment_offset = " + to_string(shard + 1);
+            if (runQuery(handle, step.c_str(), operation)) {
+                cerr << "Error: " << mysql_error(handle) << endl;
+                return mysql_errno(handle);
+            }
+        }
+
+        unsigned int error = runQuery(handle, query.c_str(), operation) ? mysql_errno(handle) : 0;
+        if (error != 0 && error != 1062) {  // ER_DUP_ENTRY
+            cerr << "Error: " << mysql_error(handle) << endl;
+        }
+
+        if (shardConns.size() > 1 &&
+            runQuery(handle, "SET SESSION auto_increment_increment = 1, auto_increment_offset = 1", operation)) {
+            cerr << "Error: " << mysql_error(handle) << endl;
+        }
+        return error;
+    }
+
+    // Refuses to start when a shard holds users that the current shard
+    // count would route elsewhere, by ID or by username; existing users are
+    // never moved. The layout a shard was last checked under is recorded,
+    // so the full scan only runs when the shard count changes.
+    void checkShardLayout() {
+        size_t count = shardConns.size();
+        for (size_t shard = 0; shard < count; ++shard) {
+            MYSQL* handle = shardConns[shard];
+            int recordedCount = 0, recordedIndex = 0;
+            RowReader<int, int>(executeQueryOn(handle, "SELECT shard_count, shard_index FROM shard_layout",
+                                               __func__)).next(recordedCount, recordedIndex);
+            if (recordedCount == static_cast<int>(count) && recordedIndex == static_cast<int>(shard)) continue;
+
+            RowReader<int, string> users(executeQueryOn(handle, "SELECT id, username FROM users", __func__));
+            int id;
+            string username;
+            size_t misplaced = 0;
+            while (users.next(id, username)) {
+                if (shardOfUser(id) != shard || shardOfUsername(username) != shard) ++misplaced;
+            }
+            if (!users.ok()) exit(1);
+            if (misplaced > 0) {
+                cerr << "Shard " << shard << " holds " << misplaced << " user(s) that belong on another shard "
+                     << "with " << count << " shard(s). Users are not moved between shards; start with the "
+                     << "shard list they were registered under." << endl;
+                exit(1);
+            }
+
+            string query = "REPLACE INTO shard_layout (id, shard_count, shard_index) VALUES (1, " +
+                          to_string(count) + ", " + to_string(shard) + ")";
+            if (runQuery(handle, query.c_str(), __func__)) {
+                cerr << "MySQL Query Error: " << mysql_error(handle) << endl;
+                exit(1);
+            }
+        }
+    }
+
+    // Reads from a shard; shard 0 reads go through the replicas
+    MYSQL_RES* readShard(size_t shard, const string& query, const char* operation) {
+        if (shard == 0) return executeReadQuery(query, operation);
+        return executeQueryOn(shardConns[shard], query, operation);
+    }
+
+    // Runs the same read on every shard at once; results are in shard order
+    // and null where a shard failed
+    vector<ResultPtr> scatterRead(const string& query, const char* operation) {
+        vector<future<MYSQL_RES*>> pending;
+        for (size_t shard = 1; shard < shardConns.size(); ++shard) {
+            MYSQL* handle = shardConns[shard];
+            pending.push_back(async(launch::async, [this, handle, &query, operation] {
+                mysql_thread_init();
+                MYSQL_RES* result = executeQueryOn(handle, query, operation);
+                mysql_thread_end();
+                return result;
+            }));
+        }
+
+        vector<ResultPtr> results;
+        results.emplace_back(executeReadQuery(query, operation));
+        for (auto& result : pending) {
+            results.emplace_back(result.get());
+        }
+        return results;
+    }
+
+    // Takes the attempts at quizIds out of the totals, inside the caller's
+    // transaction on handle and before the attempts themselves are deleted:
+    // each student's users.score and all-quiz (quiz_id 0) leaderboard
+    // buckets drop by what those quizzes contributed, and the quizzes' own
+    // buckets go. Changed totals are logged to score_changes and added to
+    // changes, to be published once the caller commits. The students' rows
+    // are locked first, as applyAttempt does, so a concurrent attempt can't
+    // interleave with the subtraction.
+    bool removeQuizScores(MYSQL* handle, const vector<int>& quizIds, vector<ScoreChange>& changes) {
+        for (size_t begin = 0; begin < quizIds.size(); begin += 1000) {
+            size_t end = min(quizIds.size(), begin + 1000);
+            string quizList;
+            for (size_t i = begin; i < end; ++i) {
+                if (i > begin) quizList += ",";
+                quizList += to_string(quizIds[i]);
+            }
+
+            string query = "SELECT sq.student_id, sq.score, u.score FROM student_quizzes sq "
+                          "JOIN users u ON u.id = sq.student_id WHERE sq.quiz_id IN (" + quizList + ") FOR UPDATE";
+            map<int, pair<int, int>> removed;  // student -> (total, score to take off)
+            RowReader<int, int, int> rows(executeQueryOn(handle, query, __func__));
+            int studentId, score, total;
+            while (rows.next(studentId, score, total)) {
+                auto& entry = removed[studentId];
+                entry.first = total;
+                entry.second += score;
+            }
+            if (!rows.ok()) return false;
+
+            query = "UPDATE users u JOIN (SELECT student_id, SUM(score) AS removed FROM student_quizzes "
+                   "WHERE quiz_id IN (" + quizList + ") GROUP BY student_id) r ON r.student_id = u.id "
+                   "SET u.score = u.score - r.removed";
+            if (runQuery(handle, query.c_str(), __func__)) {
+                cerr << "Error: " << mysql_error(handle) << endl;
+                return false;
+            }
+
+            query = "UPDATE leaderboard_buckets b JOIN (SELECT period, period_start, student_id, "
+                   "SUM(score) AS removed FROM leaderboard_buckets WHERE quiz_id IN (" + quizList + ") "
+                   "GROUP BY period, period_start, student_id) r ON r.period = b.period AND "
+                   "r.period_start = b.period_start AND r.student_id = b.student_id "
+                   "SET b.score = b.score - r.removed WHERE b.quiz_id = 0";
+            if (runQuery(handle, query.c_str(), __func__)) {
+                cerr << "Error: " << mysql_error(handle) << endl;
+                return false;
+            }
+            query = "DELETE FROM leaderboard_buckets WHERE quiz_id IN (" + quizList + ")";
+            if (runQuery(handle, query.c_str(), __func__)) {
+                cerr << "Error: " << mysql_error(handle) << endl;
+                return false;
+            }
+
+            string values;
+            for (const auto& entry : removed) {
+                if (entry.second.second == 0) continue;
+                ScoreChange change = {entry.first, entry.second.first, entry.second.first - entry.second.second};
+                if (!values.empty()) values += ", ";
+                values += "(" + to_string(change.studentId) + ", " + to_string(change.oldScore) + ", " +
+                          to_string(change.newScore) + ", " + to_string(scores->origin()) + ")";
+                changes.push_back(change);
+            }
+            if (!values.empty()) {
+                query = "INSERT INTO score_changes (student_id, old_score, new_score, origin) VALUES " + values;
+                if (runQuery(handle, query.c_str(), __func__)) {
+                    cerr << "Error: " << mysql_error(handle) << endl;
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Attempts on shards other than 0 have no foreign key to quizzes, so
+    // deleting quizzes removes them here, taking their scores out of the
+    // totals in the same transaction. Each shard commits on its own.
+    void purgeQuizAttempts(const vector<int>& quizIds) {
+        for (size_t shard = 1; shard < shardConns.size(); ++shard) {
+            MYSQL* handle = shardConns[shard];
+            vector<ScoreChange> changes;
+            bool ok = beginTransaction(handle) && removeQuizScores(handle, quizIds, changes);
+            for (const char* table : {"student_quizzes", "adaptive_attempts"}) {
+                for (size_t begin = 0; ok && begin < quizIds.size(); begin += 1000) {
+                    size_t end = min(quizIds.size(), begin + 1000);
+                    string query = "DELETE FROM " + string(table) + " WHERE quiz_id IN (";
+                    for (size_t i = begin; i < end; ++i) {
+                        if (i > begin) query += ",";
+                        query += to_string(quizIds[i]);
+                    }
+                    query += ")";
+
+                    if (runQuery(handle, query.c_str(), __func__)) {
+                        cerr << "Error: " << mysql_error(handle) << endl;
+                        ok = false;
+                    }
+                }
+            }
+            if (!ok || !commitTransaction(handle)) {
+                rollbackTransaction(handle);
+                cerr << "Error removing attempts on shard " << shard << endl;
+                continue;
+            }
+            for (const auto& change : changes) {
+                scores->publish(change);
+            }
+        }
+    }
+
+public:
+    DatabaseManager(const DatabaseConfig& config)
+        : conn(nullptr), nextReplica(0), config(config), hasWritten(false), bankIndexesReady(false),
+          sessionId(0), catalogWatermark(0), catalogOrigin(0), pollerStopping(false) {
+        conn = connect(config.primary);
+        if (!conn) {
+            cerr << "MySQL initialization failed" << endl;
+            exit(1);
+        }
+
+        passwordHasher.reset(new PasswordHasher(config.passwordHashing, config.hashingThreads,
+                                                config.hashingThreads * 4));
+
+        // A replica that cannot be reached is skipped; its reads go elsewhere
+        for (const auto& endpoint : config.replicas) {
+            MYSQL* replica = connect(endpoint);
+            if (replica) {
+                replicaConns.push_back(replica);
+            }
+        }
+
+        // A missing shard can't be skipped: its users would be unreachable
+        shardConns.push_back(conn);
+        for (const auto& endpoint : config.shards) {
+            MYSQL* shard = connect(endpoint);
+            if (!shard) {
+                cerr << "MySQL initialization failed for shard " << endpoint.host << endl;
+                exit(1);
+            }
+            shardConns.push_back(shard);
+        }
+
+        initializeDatabase(conn, schemaMigrations());
+        if (shardConns.size() > 1) {
+            for (size_t shard = 1; shard < shardConns.size(); ++shard) {
+                initializeDatabase(shardConns[shard], shardMigrations());
+            }
+            checkShardLayout();
+        }
+
+        random_device random;
+        catalogOrigin = (uint64_t(random()) << 32) | random();
+        resetCatalogSync();
+
+        // Started after migrations so a replay doesn't re-run schema changes
+        if (!config.tracePath.empty()) {
+            trace.reset(new QueryTraceWriter());
+            if (!trace->open(config.tracePath)) {
+                cerr << "Cannot write trace file: " << config.tracePath << endl;
+                exit(1);
+            }
+            sessionId = (uint64_t(random()) << 32) | random();
+        }
+
+        scores = make_shared<ScoreFeed>();
+        scorePoller = thread(&DatabaseManager::runScorePoller, this);
+
+        if (!config.journalPath.empty()) {
+            vector<DbEndpoint> endpoints(1, config.primary);
+            endpoints.insert(endpoints.end(), config.shards.begin(), config.shards.end());
+            for (const auto& endpoint : endpoints) {
+                MYSQL* handle = connect(endpoint);
+                if (!handle) {
+                    cerr << "MySQL initialization failed for the journal drainer" << endl;
+                    exit(1);
+                }
+                drainConns.push_back(handle);
+            }
+
+            journal.reset(new AttemptJournal(config.journalPath,
+                [this](const string& journalId, const vector<JournaledAttempt>& batch) {
+                    return applyJournalBatch(journalId, batch);
+                }));
+            if (!journal->open()) {
+                cerr << "Cannot open attempt journal " << config.journalPath
+                     << "; results will be written directly." << endl;
+                journal.reset();
+            }
+        }
+    }
+
+    ~DatabaseManager() {
+        {
+            lock_guard<mutex> lock(pollerMutex);
+            pollerStopping = true;
+        }
+        pollerWake.notify_all();
+        scorePoller.join();
+        journal.reset();
+        for (MYSQL* handle : drainConns) {
+            mysql_close(handle);
+        }
+        asyncReads.reset();
+        asyncWrites.reset();
+        for (MYSQL* replica : replicaConns) {
+            mysql_close(replica);
+        }
+        for (size_t shard = 1; shard < shardConns.size(); ++shard) {
+            mysql_close(shardConns[shard]);
+        }
+        mysql_close(conn);
+    }
+
+    void executeQuery(const string& query, const char* operation) {
+        if (runQuery(conn, query.c_str(), operation)) {
+            cerr << "MySQL Query Error: " << mysql_error(conn) << endl;
+        }
+    }
+
+    MYSQL_RES* executeQueryWithResult(const string& query, const char* operation) {
+        return executeQueryOn(conn, query, operation);
+    }
+
+    MYSQL_RES* executeQueryOn(MYSQL* handle, const string& query, const char* operation) {
+        if (runQuery(handle, query.c_str(), operation)) {
+            cerr << "MySQL Query Error: " << mysql_error(handle) << endl;
+            return nullptr;
+        }
+        return trackResult(mysql_store_result(handle));
+    }
+
+    // Runs a read-only query on a replica when one is available. If the
+    // replica fails the query is retried on the primary.
+    MYSQL_RES* executeReadQuery(const string& query, const char* operation) {
+        MYSQL* handle = readConnection();
+        if (handle != conn) {
+            if (runQuery(handle, query.c_str(), operation) == 0) {
+                return trackResult(mysql_store_result(handle));
+            }
+            cerr << "Replica Query Error: " << mysql_error(handle) << endl;
+        }
+        return executeQueryWithResult(query, operation);
+    }
+
+    // Starts the non-blocking query API. Reads use the first replica when one
+    // is configured, writes always use the primary.
+    void startAsync(size_t threads, size_t connectionsPerThread) {
+        const DbEndpoint& readEndpoint = config.replicas.empty() ? config.primary : config.replicas[0];
+        asyncReads.reset(new AsyncQueryExecutor(readEndpoint, config.user, config.password,
+                                                config.database, threads, connectionsPerThread));
+        asyncWrites.reset(new AsyncQueryExecutor(config.primary, config.user, config.password,
+                                                 config.database, threads, connectionsPerThread));
+    }
+
+    future<AsyncResult> readAsync(const string& query, const char* operation) {
+        if (!asyncReads) startAsync(1, 4);
+        return asyncReads->submit(query, traceAsync(TraceAsyncRead, operation, query));
+    }
+
+    future<AsyncResult> writeAsync(const string& query, const char* operation) {
+        if (!asyncWrites) startAsync(1, 4);
+        noteWrite();
+        return asyncWrites->submit(query, traceAsync(TraceAsyncWrite, operation, query));
+    }
+
+    // Runs the statements as one transaction on an async write connection;
+    // the trace records them as a single statement
+    future<AsyncResult> writeTransactionAsync(const vector<string>& statements, const char* operation) {
+        if (!asyncWrites) startAsync(1, 4);
+        noteWrite();
+        string traced;
+        for (const auto& statement : statements) {
+            if (!traced.empty()) traced += "; ";
+            traced += statement;
+        }
+        return asyncWrites->submitTransaction(statements, traceAsync(TraceAsyncWrite, operation, traced));
+    }
+
+    // Reads the applied schema version into version, -1 for a fresh
+    // database. Returns false, after reporting it, if it can't be read.
+    bool currentSchemaVersion(MYSQL* handle, int& version) {
+        version = -1;
+        if (runQuery(handle, "SELECT COALESCE(MAX(version), 0) FROM schema_version", __func__)) {
+            if (mysql_errno(handle) == 1146) return true; // ER_NO_SUCH_TABLE: fresh database
+            cerr << "MySQL Query Error: " << mysql_error(handle) << endl;
+            return false;
+        }
+
+        version = 0;
+        RowReader<int> rows(trackResult(mysql_store_result(handle)));
+        rows.next(version);
+        if (!rows.ok()) {
+            cerr << "MySQL Query Error: " << mysql_error(handle) << endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool applyMigration(MYSQL* handle, const Migration& migration) {
+        if (!beginTransaction(handle)) return false;
+
+        for (const auto& statement : migration.statements) {
+            if (runQuery(handle, statement.c_str(), __func__)) {
+                // ER_TABLE_EXISTS_ERROR, ER_DUP_FIELDNAME, ER_DUP_KEYNAME:
+                // left behind by an earlier attempt that didn't finish
+                unsigned int error = mysql_errno(handle);
+                if (error == 1050 || error == 1060 || error == 1061) {
+                    cout << "Migration " << migration.version << ": " << mysql_error(handle)
+                         << ", already applied\n";
+                    continue;
+                }
+                cerr << "Migration " << migration.version << " failed: " << mysql_error(handle) << endl;
+                rollbackTransaction(handle);
+                return false;
+            }
+        }
+
+        string query = "INSERT INTO schema_version (version, description) VALUES (" +
+                      to_string(migration.version) + ", '" +
+                      escapeString(migration.description) + "')";
+        if (runQuery(handle, query.c_str(), __func__)) {
+            cerr << "Migration " << migration.version << " failed: " << mysql_error(handle) << endl;
+            rollbackTransaction(handle);
+            return false;
+        }
+
+        return commitTransaction(handle);
+    }
+
+    // Brings the schema up to date. When it already is, this is a single
+    // SELECT; otherwise pending migrations are applied in order under a
+    // named lock so concurrently starting processes don't race each other.
+    // Startup is abandoned if the lock isn't granted within 60 seconds, and
+    // the lock is released before every return or exit once held.
+    void initializeDatabase(MYSQL* handle, const vector<Migration>& migrations) {
+        int version;
+        if (!currentSchemaVersion(handle, version)) exit(1);
+        if (version >= migrations.back().version) return;
+
+        const char* operation = __func__;
+        auto run = [&](const char* statement) {
+            if (runQuery(handle, statement, operation)) {
+                cerr << "MySQL Query Error: " << mysql_error(handle) << endl;
+            }
+        };
+
+        run("CREATE TABLE IF NOT EXISTS schema_version ("
+            "version INT PRIMARY KEY,"
+            "description VARCHAR(200) NOT NULL,"
+            "applied_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP)");
+
+        // GET_LOCK gives 1 when granted, 0 on timeout and NULL (read as 0) on error
+        int locked = 0;
+        RowReader<int>(executeQueryOn(handle, "SELECT GET_LOCK('linquiz_schema', 60)", operation)).next(locked);
+        if (locked != 1) {
+            cerr << "Could not lock the schema for migration; is another process still migrating it?" << endl;
+            exit(1);
+        }
+
+        if (!currentSchemaVersion(handle, version)) {
+            run("DO RELEASE_LOCK('linquiz_schema')");
+            exit(1);
+        }
+        for (const auto& migration : migrations) {
+            if (migration.version <= version) continue;
+
+            cout << "Applying schema migration " << migration.version << ": "
+                 << migration.description << "\n";
+            if (!applyMigration(handle, migration)) {
+                run("DO RELEASE_LOCK('linquiz_schema')");
+                exit(1);
+            }
+        }
+
+        run("DO RELEASE_LOCK('linquiz_schema')");
+    }
+
+    unique_ptr<User> authenticateUser(const string& username, const string& password) {
+        string query = "SELECT id, username, password, role, score FROM users WHERE username = '" +
+                      escapeString(username) + "'";
+
+        RowReader<int, string, string, string, int> users(
+            executeQueryOn(shardConns[shardOfUsername(username)], query, __func__));
+
+        int id, score;
+        string dbUsername, dbPassword, role;
+        if (users.next(id, dbUsername, dbPassword, role, score)) {
+            if (passwordHasher->verify(password, dbPassword).get()) {
+                if (role == "admin") {
+                    return std::make_unique<Admin>(id, dbUsername, dbPassword);
+                } else {
+                    auto student = std::make_unique<Student>(id, dbUsername, dbPassword);
+                    student->updateScore(score);
+                    return std::unique_ptr<User>(std::move(student));
+                }
+            }
+        }
+
+        return nullptr;
+    }
+
+
+bool registerUser(const string& username, const string& password, const string& role) {
+    MYSQL* handle = shardConns[shardOfUsername(username)];
+
+    // Check if username+role combination already exists
+    string checkQuery = "SELECT id FROM users WHERE username = '" + escapeString(username) +
+                       "' AND role = '" + escapeString(role) + "'";
+
+    MYSQL_RES* result = executeQueryOn(handle, checkQuery, __func__);
+    if (result && mysql_num_rows(result) > 0) {
+        freeResult(result);
+        return false; // Username already exists for this specific role
+    }
+    if (result) freeResult(result);
+
+    // Insert new user with a salted hash, computed off this thread
+    string storedPassword = passwordHasher->hash(password).get();
+    string query = "INSERT INTO users (username, password, role) VALUES ('" +
+                  escapeString(username) + "', '" +
+                  escapeString(storedPassword) + "', '" +
+                  escapeString(role) + "')";
+
+    return insertUsers(shardOfUsername(username), query, __func__) == 0;
+}
+
+    // Creates the accounts listed in a roster file (see parseRosterLine).
+    // The file is read 1000 lines at a time; see importRosterChunk. Existing
+    // accounts, repeats within the file and malformed lines are reported by
+    // line number and skipped.
+    bool importRoster(const string& path) {
+        ifstream file(path);
+        if (!file) {
+            cerr << "Cannot read roster " << path << endl;
+            return false;
+        }
+
+        const size_t chunkSize = 1000;
+        unordered_map<string, int> firstLine;  // rosterKey -> line it first appeared on
+        vector<RosterEntry> chunk;
+        size_t imported = 0, skipped = 0;
+        int lineNumber = 0;
+        string text;
+        auto start = chrono::steady_clock::now();
+
+        bool ok = true, more = true;
+        while (ok && more) {
+            more = static_cast<bool>(getline(file, text));
+            if (more) {
+                ++lineNumber;
+                RosterEntry entry;
+                string problem = parseRosterLine(text, entry);
+                if (!problem.empty()) {
+                    cout << "Line " << lineNumber << ": " << problem << "\n";
+                    ++skipped;
+                    continue;
+                }
+                if (entry.username.empty()) continue;
+
+                auto first = firstLine.insert({rosterKey(entry.username, entry.role), lineNumber});
+                if (!first.second) {
+                    cout << "Line " << lineNumber << ": " << entry.username << " (" << entry.role
+                         << ") repeats line " << first.first->second << "\n";
+                    ++skipped;
+                    continue;
+                }
+                entry.line = lineNumber;
+                chunk.push_back(std::move(entry));
+            }
+
+            if (chunk.size() == chunkSize || (!more && !chunk.empty())) {
+                ok = importRosterChunk(chunk, imported, skipped);
+                chunk.clear();
+            }
+        }
+
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "Imported " << imported << " account(s), skipped " << skipped << " line(s) in "
+             << seconds << " s.\n";
+        if (!ok) cerr << "Import stopped at line " << lineNumber << "." << endl;
+        return ok;
+    }
+
+    // Every shard's existing accounts among the chunk are found with one
+    // query per shard. The passwords of the rest are hashed on all hashing
+    // threads at once, unless they already are stored hashes, and they are
+    // added with one multi-row INSERT (one transaction) per shard, through
+    // that shard's connection so new IDs keep their shard offsets. If the
+    // INSERT still hits a duplicate, registered meanwhile or equal only under
+    // the column's collation, that shard's part is retried row by row.
+    bool importRosterChunk(vector<RosterEntry>& chunk, size_t& imported, size_t& skipped) {
+        vector<vector<RosterEntry*>> byShard(shardConns.size());
+        for (auto& entry : chunk) {
+            byShard[shardOfUsername(entry.username)].push_back(&entry);
+        }
+
+        vector<future<string>> hashes;
+        for (size_t shard = 0; shard < byShard.size(); ++shard) {
+            vector<RosterEntry*>& entries = byShard[shard];
+            if (entries.empty()) continue;
+
+            string query = "SELECT username, role FROM users WHERE username IN (";
+            for (size_t i = 0; i < entries.size(); ++i) {
+                query += (i > 0 ? ", '" : "'") + escapeString(entries[i]->username) + "'";
+            }
+            query += ")";
+
+            unordered_set<string> existing;
+            RowReader<string, string> rows(executeQueryOn(shardConns[shard], query, __func__));
+            string username, role;
+            while (rows.next(username, role)) {
+                existing.insert(rosterKey(username, role));
+            }
+            if (!rows.ok()) return false;
+
+            vector<RosterEntry*> fresh;
+            for (RosterEntry* entry : entries) {
+                if (existing.count(rosterKey(entry->username, entry->role))) {
+                    cout << "Line " << entry->line << ": " << entry->username << " (" << entry->role
+                         << ") already exists\n";
+                    ++skipped;
+                    continue;
+                }
+                if (!PasswordHasher::isHashed(entry->password)) {
+                    hashes.push_back(passwordHasher->hash(entry->password));
+                }
+                fresh.push_back(entry);
+            }
+            entries.swap(fresh);
+        }
+
+        size_t nextHash = 0;
+        for (auto& entries : byShard) {
+            for (RosterEntry* entry : entries) {
+                if (!PasswordHasher::isHashed(entry->password)) entry->password = hashes[nextHash++].get();
+            }
+        }
+
+        auto values = [this](const RosterEntry& entry) {
+            return "('" + escapeString(entry.username) + "', '" + escapeString(entry.password) + "', '" +
+                   entry.role + "')";
+        };
+        for (size_t shard = 0; shard < byShard.size(); ++shard) {
+            const vector<RosterEntry*>& entries = byShard[shard];
+            if (entries.empty()) continue;
+
+            string query = "INSERT INTO users (username, password, role) VALUES ";
+            for (size_t i = 0; i < entries.size(); ++i) {
+                query += (i > 0 ? ", " : "") + values(*entries[i]);
+            }
+            unsigned int error = insertUsers(shard, query, __func__);
+            if (error == 0) {
+                imported += entries.size();
+                continue;
+            }
+            if (error != 1062) return false;  // ER_DUP_ENTRY
+
+            for (RosterEntry* entry : entries) {
+                query = "INSERT INTO users (username, password, role) VALUES " + values(*entry);
+                error = insertUsers(shard, query, __func__);
+                if (error == 0) {
+                    ++imported;
+                } else if (error == 1062) {
+                    cout << "Line " << entry->line << ": " << entry->username << " (" << entry->role
+                         << ") already exists\n";
+                    ++skipped;
+                } else {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    vector<Quiz> getAllQuizzes() {
+        MemoryTagScope scope(TagCatalog);
+        vector<Quiz> quizzes;
+        string query = "SELECT id, title, description, time_limit FROM quizzes";
+
+        RowReader<int, string, string, int> rows(executeReadQuery(query, __func__));
+        int id, timeLimit;
+        string title, description;
+        while (rows.next(id, title, description, timeLimit)) {
+            Quiz quiz(id, title, description);
+
+            // Load questions for this quiz
+            string questionQuery = "SELECT id, text, option1, option2, option3, option4, correct_option, quiz_id "
+                                 "FROM questions WHERE quiz_id = " + to_string(id);
+            for (const auto& question : QuestionRows(executeReadQuery(questionQuery, __func__)).all<QuestionRow>()) {
+                quiz.addQuestion(question.toQuestion());
+            }
+
+            quizzes.push_back(quiz);
+        }
+        return quizzes;
+    }
+
+    // Keyset pagination: returns up to limit quizzes with id > afterId in id
+    // order, without their questions but with the question count. Pass the
+    // last returned ID as afterId to get the next page.
+    vector<Quiz> getQuizPage(int afterId, int limit) {
+        MemoryTagScope scope(TagCatalog);
+        vector<Quiz> quizzes;
+        string query = "SELECT q.id, q.title, q.description, "
+                      "(SELECT COUNT(*) FROM questions WHERE quiz_id = q.id) "
+                      "FROM quizzes q WHERE q.id > " + to_string(afterId) +
+                      " ORDER BY q.id LIMIT " + to_string(limit);
+
+        QuizRows rows(executeReadQuery(query, __func__));
+        int id, questionCount;
+        string title, description;
+        while (rows.next(id, title, description, questionCount)) {
+            Quiz quiz(id, title, description);
+            quiz.setQuestionCount(questionCount);
+            quizzes.push_back(quiz);
+        }
+        return quizzes;
+    }
+
+    vector<Question> getQuestionPage(int quizId, int afterId, int limit) {
+        MemoryTagScope scope(TagCatalog);
+        vector<Question> questions;
+        string query = "SELECT id, text, option1, option2, option3, option4, correct_option, quiz_id "
+                      "FROM questions WHERE quiz_id = " + to_string(quizId) +
+                      " AND id > " + to_string(afterId) +
+                      " ORDER BY id LIMIT " + to_string(limit);
+
+        for (const auto& row : QuestionRows(executeReadQuery(query, __func__)).all<QuestionRow>()) {
+            questions.push_back(row.toQuestion());
+        }
+        return questions;
+    }
+
+    // Item parameters of every question in a quiz, without the question text
+    ItemBank getItemBank(int quizId) {
+        MemoryTagScope scope(TagCatalog);
+        ItemBank bank;
+        string query = "SELECT id, irt_a, irt_b, irt_c FROM questions WHERE quiz_id = " + to_string(quizId);
+
+        RowReader<int, Nullable<double>, Nullable<double>, Nullable<double>> items(
+            executeReadQuery(query, __func__));
+        int id;
+        Nullable<double> a, b, c;
+        while (items.next(id, a, b, c)) {
+            bank.add(id, a.present ? a.value : 1, b.present ? b.value : 0, c.present ? c.value : 0.25);
+        }
+        bank.finalize();
+        return bank;
+    }
+
+    unique_ptr<Question> getQuestionById(int questionId) {
+        MemoryTagScope scope(TagCatalog);
+        string query = "SELECT id, text, option1, option2, option3, option4, correct_option, quiz_id "
+                      "FROM questions WHERE id = " + to_string(questionId);
+
+        vector<QuestionRow> rows = QuestionRows(executeReadQuery(query, __func__)).all<QuestionRow>();
+        if (rows.empty()) return nullptr;
+        return unique_ptr<Question>(new Question(rows[0].toQuestion()));
+    }
+
+    // Adds one attempt's answers to the per-question counts used for
+    // calibration, in a single statement
+    void recordResponses(const vector<pair<int, bool>>& responses) {
+        if (responses.empty()) return;
+
+        string answered, correct;
+        for (const auto& response : responses) {
+            string id = to_string(response.first);
+            answered += (answered.empty() ? "" : ",") + id;
+            if (response.second) correct += (correct.empty() ? "" : ",") + id;
+        }
+
+        string query = "UPDATE questions SET times_answered = times_answered + 1, times_correct = times_correct + " +
+                      (correct.empty() ? string("0") : "(id IN (" + correct + "))") +
+                      " WHERE id IN (" + answered + ")";
+        noteWrite();
+        executeQuery(query, __func__);
+    }
+
+    // Refits the difficulty of every question answered at least minAnswers
+    // times from its share of correct answers, after taking out guessing.
+    // MySQL applies single-table SET assignments left to right, so irt_b
+    // first holds the clamped guess-adjusted proportion and is then turned
+    // into a difficulty. Returns the number of questions updated, or -1.
+    int recalibrateItemParameters(int minAnswers) {
+        string query =
+            "UPDATE questions SET "
+            "irt_b = LEAST(0.98, GREATEST(0.02, (times_correct / times_answered - irt_c) / (1 - irt_c))), "
+            "irt_b = LN((1 - irt_b) / irt_b) / (1.7 * irt_a) "
+            "WHERE times_answered >= " + to_string(minAnswers);
+
+        noteWrite();
+        if (runQuery(conn, query.c_str(), __func__)) {
+            cerr << "Error: " << mysql_error(conn) << endl;
+            return -1;
+        }
+        return static_cast<int>(mysql_affected_rows(conn));
+    }
+
+    // Quizzes with the given IDs in ID order, with question counts; IDs of
+    // quizzes that no longer exist are skipped
+    vector<Quiz> getQuizzesByIds(const vector<int>& quizIds) {
+        MemoryTagScope scope(TagCatalog);
+        vector<Quiz> quizzes;
+        if (quizIds.empty()) return quizzes;
+
+        string query = "SELECT q.id, q.title, q.description, "
+                      "(SELECT COUNT(*) FROM questions WHERE quiz_id = q.id) "
+                      "FROM quizzes q WHERE q.id IN (";
+        for (size_t i = 0; i < quizIds.size(); ++i) {
+            if (i > 0) query += ",";
+            query += to_string(quizIds[i]);
+        }
+        query += ") ORDER BY q.id";
+
+        QuizRows rows(executeReadQuery(query, __func__));
+        int id, questionCount;
+        string title, description;
+        while (rows.next(id, title, description, questionCount)) {
+            Quiz quiz(id, title, description);
+            quiz.setQuestionCount(questionCount);
+            quizzes.push_back(quiz);
+        }
+        return quizzes;
+    }
+
+    // Every quiz the student has a recorded attempt at; read once at login
+    QuizIdSet getCompletedQuizzes(int studentId) {
+        QuizIdSet completed;
+        string query = "SELECT quiz_id FROM student_quizzes WHERE student_id = " +
+                      to_string(studentId) + " ORDER BY quiz_id";
+
+        RowReader<int> rows(readShard(shardOfUser(studentId), query, __func__));
+        int quizId;
+        while (rows.next(quizId)) {
+            completed.add(quizId);
+        }
+        return completed;
+    }
+
+    // Loads one quiz with all of its questions, or nullptr if it doesn't exist
+    unique_ptr<Quiz> getQuizById(int quizId) {
+        string query = "SELECT id, title, description FROM quizzes WHERE id = " + to_string(quizId);
+
+        int id;
+        string title, description;
+        if (!RowReader<int, string, string>(executeReadQuery(query, __func__)).next(id, title, description)) {
+            return nullptr;
+        }
+        unique_ptr<Quiz> quiz(new Quiz(id, title, description));
+
+        vector<Question> page;
+        int afterId = 0;
+        do {
+            page = getQuestionPage(quizId, afterId, 500);
+            for (const auto& question : page) {
+                quiz->addQuestion(question);
+                afterId = question.getId();
+            }
+        } while (page.size() == 500);
+
+        return quiz;
+    }
+
+    // The quiz as currently cached, loading it on first use. The returned
+    // quiz never changes, so an attempt can run on it while admins edit.
+    shared_ptr<const Quiz> pinQuiz(int quizId) {
+        MemoryTagScope scope(TagCatalog);
+        syncCatalog();
+        shared_ptr<const Quiz> quiz = catalog.pin(quizId);
+        if (quiz) return quiz;
+
+        uint64_t basedOn = catalog.version();
+        quiz = getQuizById(quizId);
+        if (!quiz) return nullptr;
+        // Skipped if an edit landed while loading; the next pin loads again
+        catalog.update([&](CatalogSnapshot& snapshot) { snapshot.quizzes[quizId] = quiz; }, basedOn);
+        return quiz;
+    }
+
+    bool addQuiz(const Quiz& quiz) {
+        string query = "INSERT INTO quizzes (title, description) VALUES ('" +
+                  escapeString(quiz.getTitle()) + "', '" +
+                  escapeString(quiz.getDescription()) + "')";
+
+        if (!beginTransaction()) return false;
+        if (runQuery(conn, query.c_str(), __func__)) {
+            cerr << "Error: " << mysql_error(conn) << endl;
+            rollbackTransaction();
+            return false;
+        }
+
+        int quizId = static_cast<int>(mysql_insert_id(conn));
+        if (!logCatalogChanges(conn, {{quizId, 0, false}}) || !commitTransaction()) {
+            rollbackTransaction();
+            return false;
+        }
+        if (bankIndexesReady) {
+            searchIndex.addQuiz(quizId, quiz.getTitle(), quiz.getDescription());
+        }
+
+        // Add questions
+        for (const auto& question : quiz.getQuestions()) {
+            addQuestion(quizId, question);
+        }
+
+        return true;
+    }
+
+    bool addQuestion(int quizId, const Question& question) {
+        string query = "INSERT INTO questions (quiz_id, text, option1, option2, option3, option4, correct_option, irt_c) VALUES (" +
                       to_string(quizId) + ", '" +
                       escapeString(question.getText()) + "', '" +
                       escapeString(question.getOptions()[0]) + "', '" +
                       escapeString(question.getOptions()[1]) + "', " ;
 
-        // Handle optional options
-        if (question.getOptions().size() > 2) {
-            query += "'" + escapeString(question.getOptions()[2]) + "', ";
-        } else {
-            query += "NULL, ";
+        // Handle optional options
+        if (question.getOptions().size() > 2) {
+            query += "'" + escapeString(question.getOptions()[2]) + "', ";
+        } else {
+            query += "NULL, ";
+        }
+
+        if (question.getOptions().size() > 3) {
+            query += "'" + escapeString(question.getOptions()[3]) + "', ";
+        } else {
+            query += "NULL, ";
+        }
+
+        query += to_string(question.getCorrectOption()) + ", " +
+                 to_string(1.0 / question.getOptions().size()) + ")";
+
+        if (!beginTransaction()) return false;
+        if (runQuery(conn, query.c_str(), __func__)) {
+            cerr << "Error: " << mysql_error(conn) << endl;
+            rollbackTransaction();
+            return false;
+        }
+
+        int questionId = static_cast<int>(mysql_insert_id(conn));
+        if (!logCatalogChanges(conn, {{quizId, questionId, false}}) || !commitTransaction()) {
+            rollbackTransaction();
+            return false;
+        }
+        if (bankIndexesReady) {
+            searchIndex.addQuestion(questionId, quizId, question.getText(), question.getOptions());
+            duplicateDetector.add(questionId, quizId, question.getText(), question.getOptions());
+        }
+        catalog.update([&](CatalogSnapshot& snapshot) {
+            auto cached = snapshot.quizzes.find(quizId);
+            if (cached == snapshot.quizzes.end()) return;
+            shared_ptr<Quiz> edited(new Quiz(*cached->second));
+            edited->addQuestion(Question(questionId, question.getText(), question.getOptions(),
+                                         question.getCorrectOption(), quizId));
+            cached->second = edited;
+        });
+        return true;
+    }
+
+    void uncacheQuizzes(const vector<int>& quizIds) {
+        if (quizIds.empty()) return;
+        catalog.update([&](CatalogSnapshot& snapshot) {
+            for (int quizId : quizIds) {
+                snapshot.quizzes.erase(quizId);
+            }
+        });
+    }
+
+    // Replaces each cached quiz that holds one of the questions with a copy
+    // without them
+    void uncacheQuestions(const vector<int>& questionIds) {
+        if (questionIds.empty()) return;
+        unordered_set<int> removed(questionIds.begin(), questionIds.end());
+        catalog.update([&](CatalogSnapshot& snapshot) {
+            for (auto& cached : snapshot.quizzes) {
+                const Quiz& quiz = *cached.second;
+                auto holds = [&](const Question& question) { return removed.count(question.getId()) > 0; };
+                if (none_of(quiz.getQuestions().begin(), quiz.getQuestions().end(), holds)) continue;
+
+                shared_ptr<Quiz> edited(new Quiz(quiz.getId(), quiz.getTitle(), quiz.getDescription()));
+                for (const auto& question : quiz.getQuestions()) {
+                    if (!holds(question)) edited->addQuestion(question);
+                }
+                cached.second = edited;
+            }
+        });
+    }
+
+    // The INSERT that logs changes[begin, end) in catalog_changes
+    string catalogChangesInsert(const vector<CatalogChange>& changes, size_t begin, size_t end) {
+        string query = "INSERT INTO catalog_changes (quiz_id, question_id, deleted, origin) VALUES ";
+        for (size_t i = begin; i < end; ++i) {
+            const CatalogChange& change = changes[i];
+            if (i > begin) query += ",";
+            query += "(" + (change.quizId ? to_string(change.quizId) : string("NULL")) + ", " +
+                     (change.questionId ? to_string(change.questionId) : string("NULL")) + ", " +
+                     (change.deleted ? "1" : "0") + ", " + to_string(catalogOrigin) + ")";
+        }
+        return query;
+    }
+
+    // Records changes in catalog_changes, normally inside the transaction
+    // that made them so other processes see both or neither
+    bool logCatalogChanges(MYSQL* handle, const vector<CatalogChange>& changes) {
+        const size_t chunkSize = 1000;
+        for (size_t begin = 0; begin < changes.size(); begin += chunkSize) {
+            size_t end = min(changes.size(), begin + chunkSize);
+            string query = catalogChangesInsert(changes, begin, end);
+            if (runQuery(handle, query.c_str(), __func__)) {
+                cerr << "Error logging catalog change: " << mysql_error(handle) << endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Questions with the given IDs, read from the primary so that changes
+    // just made by another process are seen; missing IDs are skipped
+    vector<Question> getQuestionsByIds(const vector<int>& questionIds) {
+        MemoryTagScope scope(TagCatalog);
+        vector<Question> questions;
+        if (questionIds.empty()) return questions;
+
+        string query = "SELECT id, text, option1, option2, option3, option4, correct_option, quiz_id "
+                      "FROM questions WHERE id IN (";
+        for (size_t i = 0; i < questionIds.size(); ++i) {
+            if (i > 0) query += ",";
+            query += to_string(questionIds[i]);
+        }
+        query += ") ORDER BY id";
+
+        for (const auto& row : QuestionRows(executeQueryWithResult(query, __func__)).all<QuestionRow>()) {
+            questions.push_back(row.toQuestion());
+        }
+        return questions;
+    }
+
+    // Starts following catalog_changes after the changes that have settled
+    // (see syncCatalog) and drops the caches, which may have missed some
+    void resetCatalogSync() {
+        unsigned long long watermark = 0;
+        RowReader<unsigned long long>(executeQueryWithResult(
+            "SELECT COALESCE(MAX(seq), 0) FROM catalog_changes WHERE changed_at < NOW() - INTERVAL 10 SECOND",
+            __func__)).next(watermark);
+        catalogWatermark = watermark;
+
+        catalogApplied.clear();
+        catalog.update([](CatalogSnapshot& snapshot) { snapshot.quizzes.clear(); });
+        bankIndexesReady = false;
+        lastCatalogSync = chrono::steady_clock::now();
+    }
+
+    // Applies the catalog changes other processes have logged, at most once
+    // a second. A change's seq is assigned before its transaction commits,
+    // so a lower seq can appear after a higher one; changes stay above the
+    // watermark, remembered in catalogApplied, until they are 10 seconds old.
+    // The work done is proportional to the number of changes.
+    void syncCatalog() {
+        auto now = chrono::steady_clock::now();
+        if (now - lastCatalogSync < chrono::seconds(1)) return;
+        if (now - lastCatalogSync > chrono::hours(12)) {
+            resetCatalogSync();
+            return;
+        }
+        lastCatalogSync = now;
+
+        const int pageSize = 1000;
+        uint64_t cursor = catalogWatermark;
+        bool settledSoFar = true;
+        int rows;
+        do {
+            string query = "SELECT seq, quiz_id, question_id, deleted, origin = " + to_string(catalogOrigin) +
+                          ", changed_at < NOW() - INTERVAL 10 SECOND FROM catalog_changes WHERE seq > " +
+                          to_string(cursor) + " ORDER BY seq LIMIT " + to_string(pageSize);
+            MYSQL_RES* result = executeQueryWithResult(query, __func__);
+            if (!result) return;
+
+            vector<CatalogChange> changes;
+            rows = 0;
+            {
+                // quiz_id and question_id are NULL, read as 0, where they don't apply
+                RowReader<unsigned long long, int, int, int, int, int> log(result);
+                unsigned long long seq;
+                int quizId, questionId, deleted, own, settled;
+                while (log.next(seq, quizId, questionId, deleted, own, settled)) {
+                    ++rows;
+                    cursor = seq;
+                    if (!own && !catalogApplied.count(cursor)) {
+                        changes.push_back({quizId, questionId, deleted != 0});
+                    }
+
+                    if (settledSoFar && settled) {
+                        catalogWatermark = cursor;
+                    } else {
+                        settledSoFar = false;
+                        catalogApplied.insert(cursor);
+                    }
+                }
+            }
+            applyCatalogChanges(changes);
+        } while (rows == pageSize);
+
+        catalogApplied.erase(catalogApplied.begin(), catalogApplied.upper_bound(catalogWatermark));
+    }
+
+    // Brings the quiz cache and the bank indexes in line with changes made
+    // by another process. Added rows are read back in one query per table;
+    // rows deleted again since are simply not found.
+    void applyCatalogChanges(const vector<CatalogChange>& changes) {
+        MemoryTagScope scope(TagCatalog);
+        vector<int> addedQuizIds, addedQuestionIds, droppedQuizIds, droppedQuestionIds;
+        for (const auto& change : changes) {
+            if (change.questionId == 0) {
+                (change.deleted ? droppedQuizIds : addedQuizIds).push_back(change.quizId);
+            } else {
+                (change.deleted ? droppedQuestionIds : addedQuestionIds).push_back(change.questionId);
+            }
+        }
+
+        for (int quizId : droppedQuizIds) {
+            searchIndex.removeQuiz(quizId);
+            duplicateDetector.removeQuiz(quizId);
+        }
+        for (int questionId : droppedQuestionIds) {
+            searchIndex.removeQuestion(questionId);
+            duplicateDetector.remove(questionId);
+        }
+        uncacheQuizzes(droppedQuizIds);
+        uncacheQuestions(droppedQuestionIds);
+
+        if (bankIndexesReady && !addedQuizIds.empty()) {
+            string query = "SELECT id, title, description FROM quizzes WHERE id IN (";
+            for (size_t i = 0; i < addedQuizIds.size(); ++i) {
+                if (i > 0) query += ",";
+                query += to_string(addedQuizIds[i]);
+            }
+            query += ")";
+
+            RowReader<int, string, string> quizzes(executeQueryWithResult(query, __func__));
+            int id;
+            string title, description;
+            while (quizzes.next(id, title, description)) {
+                searchIndex.addQuiz(id, title, description);
+            }
+        }
+
+        vector<Question> added = getQuestionsByIds(addedQuestionIds);
+        if (added.empty()) return;
+        if (bankIndexesReady) {
+            for (const auto& question : added) {
+                searchIndex.addQuestion(question.getId(), question.getQuizId(), question.getText(),
+                                        question.getOptions());
+                duplicateDetector.add(question.getId(), question.getQuizId(), question.getText(),
+                                      question.getOptions());
+            }
+        }
+        catalog.update([&](CatalogSnapshot& snapshot) {
+            for (const auto& question : added) {
+                auto cached = snapshot.quizzes.find(question.getQuizId());
+                if (cached == snapshot.quizzes.end()) continue;
+                const vector<Question>& present = cached->second->getQuestions();
+                if (any_of(present.begin(), present.end(),
+                           [&](const Question& q) { return q.getId() == question.getId(); })) {
+                    continue;
+                }
+                shared_ptr<Quiz> edited(new Quiz(*cached->second));
+                edited->addQuestion(question);
+                cached->second = edited;
+            }
+        });
+    }
+
+    bool beginTransaction(MYSQL* handle) {
+        noteWrite();
+        return startTransaction(handle);
+    }
+
+    // beginTransaction without noteWrite, for the journal drainer thread
+    bool startTransaction(MYSQL* handle) {
+        if (runQuery(handle, "START TRANSACTION", __func__)) {
+            cerr << "Error starting transaction: " << mysql_error(handle) << endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool commitTransaction(MYSQL* handle) {
+        if (mysql_commit(handle)) {
+            cerr << "Error committing transaction: " << mysql_error(handle) << endl;
+            mysql_rollback(handle);
+            return false;
+        }
+        return true;
+    }
+
+    void rollbackTransaction(MYSQL* handle) {
+        mysql_rollback(handle);
+    }
+
+    bool beginTransaction() { return beginTransaction(conn); }
+    bool commitTransaction() { return commitTransaction(conn); }
+    void rollbackTransaction() { rollbackTransaction(conn); }
+
+    // Folds one attempt into the student's total incrementally, inside the
+    // caller's transaction on handle. A retake only adds (new - old) for the
+    // same quiz, so users.score stays equal to SUM(student_quizzes.score). The
+    // student's row is locked while the delta is computed, which serializes
+    // concurrent attempts by the same student. *found is set to false, and
+    // nothing changes, when the student doesn't exist. submittedAt (µs since
+    // the epoch) becomes completed_at and picks the leaderboard buckets. A
+    // changed total is logged to score_changes and returned in *change, to be
+    // published once the caller commits.
+    bool applyAttempt(MYSQL* handle, int studentId, int quizId, int score, int64_t submittedAt,
+                      ScoreChange* change, bool* found) {
+        string query = "SELECT sq.score, u.score FROM users u "
+                      "LEFT JOIN student_quizzes sq ON sq.student_id = u.id AND sq.quiz_id = " +
+                      to_string(quizId) + " WHERE u.id = " + to_string(studentId) + " FOR UPDATE";
+
+        MYSQL_RES* result = executeQueryOn(handle, query, __func__);
+        if (!result) return false;
+        RowReader<int, int> student(result);
+        int previousScore = 0, total = 0;  // no attempt yet: NULL reads as 0
+        *found = student.next(previousScore, total);
+        if (!student.ok()) return false;
+        if (!*found) return true;
+
+        int delta = score - previousScore;
+        string at = "FROM_UNIXTIME(" + to_string(submittedAt / 1000000) + "." +
+                   to_string(1000000 + submittedAt % 1000000).substr(1) + ")";
+
+        query = "INSERT INTO student_quizzes (student_id, quiz_id, score, completed_at) VALUES (" +
+               to_string(studentId) + ", " +
+               to_string(quizId) + ", " +
+               to_string(score) + ", " + at + ") "
+               "ON DUPLICATE KEY UPDATE score = VALUES(score), completed_at = VALUES(completed_at)";
+
+        if (runQuery(handle, query.c_str(), __func__)) {
+            cerr << "Error: " << mysql_error(handle) << endl;
+            return false;
+        }
+        if (!applyAttemptToBuckets(handle, studentId, quizId, score, at)) return false;
+
+        // Update user's total score by the difference only
+        if (delta != 0) {
+            query = "UPDATE users SET score = score + " + to_string(delta) +
+                   " WHERE id = " + to_string(studentId);
+
+            if (runQuery(handle, query.c_str(), __func__)) {
+                cerr << "Error: " << mysql_error(handle) << endl;
+                return false;
+            }
+
+            query = "INSERT INTO score_changes (student_id, old_score, new_score, origin) VALUES (" +
+                   to_string(studentId) + ", " + to_string(total) + ", " + to_string(total + delta) + ", " +
+                   to_string(scores->origin()) + ")";
+            if (runQuery(handle, query.c_str(), __func__)) {
+                cerr << "Error: " << mysql_error(handle) << endl;
+                return false;
+            }
+        }
+
+        *change = {studentId, total, total + delta};
+        return true;
+    }
+
+    // Keeps leaderboard_buckets in step with an attempt made at time (an SQL
+    // expression): the quiz's bucket in each period takes the new score and
+    // the period's all-quiz total moves by the change, so a window's ranking
+    // reads one bucket instead of grouping its attempts.
+    bool applyAttemptToBuckets(MYSQL* handle, int studentId, int quizId, int score, const string& time) {
+        string student = to_string(studentId);
+        string quiz = to_string(quizId);
+
+        string query = "SELECT period, score FROM leaderboard_buckets WHERE student_id = " + student +
+                      " AND quiz_id = " + quiz + " AND (";
+        for (const char* period : leaderboardPeriods) {
+            if (period != leaderboardPeriods[0]) query += " OR ";
+            query += "(period = '" + string(period) + "' AND period_start = " + periodStartSql(period, time) + ")";
+        }
+        query += ")";
+
+        map<string, int> previous;
+        RowReader<string, int> rows(executeQueryOn(handle, query, __func__));
+        string period;
+        int previousScore;
+        while (rows.next(period, previousScore)) {
+            previous[period] = previousScore;
+        }
+        if (!rows.ok()) return false;
+
+        string quizBuckets, totalBuckets;
+        for (const char* name : leaderboardPeriods) {
+            string prefix = string(quizBuckets.empty() ? "" : ", ") + "('" + name + "', " +
+                            periodStartSql(name, time) + ", ";
+            quizBuckets += prefix + quiz + ", " + student + ", " + to_string(score) + ")";
+            totalBuckets += prefix + "0, " + student + ", " + to_string(score - previous[name]) + ")";
+        }
+
+        query = "INSERT INTO leaderboard_buckets (period, period_start, quiz_id, student_id, score) VALUES " +
+               quizBuckets + " ON DUPLICATE KEY UPDATE score = VALUES(score)";
+        if (runQuery(handle, query.c_str(), __func__)) {
+            cerr << "Error: " << mysql_error(handle) << endl;
+            return false;
+        }
+        query = "INSERT INTO leaderboard_buckets (period, period_start, quiz_id, student_id, score) VALUES " +
+               totalBuckets + " ON DUPLICATE KEY UPDATE score = score + VALUES(score)";
+        if (runQuery(handle, query.c_str(), __func__)) {
+            cerr << "Error: " << mysql_error(handle) << endl;
+            return false;
+        }
+        return true;
+    }
+
+    static bool connectionLost(MYSQL* handle) {
+        unsigned int error = mysql_errno(handle);
+        return error == 2006 || error == 2013;  // CR_SERVER_GONE_ERROR, CR_SERVER_LOST
+    }
+
+    // Applies journaled attempts exactly once. Each shard keeps the highest
+    // seq it has applied from every journal and moves it in the same
+    // transaction as the attempts, so a retried or replayed batch skips what
+    // is already in. Attempts whose student or quiz was deleted meanwhile
+    // are dropped rather than retried forever; quizzes live on shard 0 only,
+    // so the batch's quizzes are looked up there first. Runs on the drainer
+    // thread, on its own connections. A connection the server dropped is
+    // replaced and its shard's whole transaction run again on the new one;
+    // the old transaction either committed, and is skipped, or is gone.
+    bool applyJournalBatch(const string& journalId, const vector<JournaledAttempt>& batch) {
+        traceThisThread = false;
+        vector<vector<const JournaledAttempt*>> byShard(shardConns.size());
+        for (const auto& attempt : batch) {
+            byShard[shardOfUser(attempt.studentId)].push_back(&attempt);
+        }
+
+        set<int> liveQuizzes;
+        if (!existingQuizzes(batch, liveQuizzes)) return false;
+
+        string id = escapeString(drainConns[0], journalId);
+        for (size_t shard = 0; shard < byShard.size(); ++shard) {
+            if (byShard[shard].empty()) continue;
+
+            vector<ScoreChange> changes;
+            bool applied = applyJournalShard(drainConns[shard], id, byShard[shard], liveQuizzes, changes);
+            if (!applied && connectionLost(drainConns[shard])) {
+                MYSQL* fresh = connect(shard == 0 ? config.primary : config.shards[shard - 1]);
+                if (!fresh) return false;
+                mysql_close(drainConns[shard]);
+                drainConns[shard] = fresh;
+                changes.clear();
+                applied = applyJournalShard(fresh, id, byShard[shard], liveQuizzes, changes);
+            }
+            if (!applied) return false;
+            for (const auto& change : changes) {
+                scores->publish(change);
+            }
+        }
+        return true;
+    }
+
+    // Which of the quizzes a journal batch refers to still exist, read on
+    // the drainer's shard 0 connection
+    bool existingQuizzes(const vector<JournaledAttempt>& batch, set<int>& live) {
+        set<int> wanted;
+        for (const auto& attempt : batch) wanted.insert(attempt.quizId);
+
+        string query = "SELECT id FROM quizzes WHERE id IN (";
+        for (int quizId : wanted) {
+            if (quizId != *wanted.begin()) query += ", ";
+            query += to_string(quizId);
+        }
+        query += ")";
+
+        MYSQL_RES* result = executeQueryOn(drainConns[0], query, __func__);
+        if (!result && connectionLost(drainConns[0])) {
+            MYSQL* fresh = connect(config.primary);
+            if (!fresh) return false;
+            mysql_close(drainConns[0]);
+            drainConns[0] = fresh;
+            result = executeQueryOn(fresh, query, __func__);
+        }
+        if (!result) return false;
+
+        RowReader<int> rows(result);
+        int quizId;
+        while (rows.next(quizId)) {
+            live.insert(quizId);
+        }
+        return rows.ok();
+    }
+
+    // One shard's part of applyJournalBatch, in its own transaction.
+    // Attempts at quizzes not in liveQuizzes are dropped. The score changes
+    // to publish once it has committed go to changes.
+    bool applyJournalShard(MYSQL* handle, const string& id, const vector<const JournaledAttempt*>& attempts,
+                           const set<int>& liveQuizzes, vector<ScoreChange>& changes) {
+        if (!startTransaction(handle)) return false;
+
+        string query = "INSERT IGNORE INTO journal_progress (journal_id, applied_seq) VALUES ('" + id + "', 0)";
+        if (runQuery(handle, query.c_str(), __func__)) {
+            cerr << "Error: " << mysql_error(handle) << endl;
+            rollbackTransaction(handle);
+            return false;
+        }
+        query = "SELECT applied_seq FROM journal_progress WHERE journal_id = '" + id + "' FOR UPDATE";
+        MYSQL_RES* result = executeQueryOn(handle, query, __func__);
+        if (!result) {
+            rollbackTransaction(handle);
+            return false;
+        }
+        RowReader<unsigned long long> progress(result);
+        unsigned long long appliedSeq = 0;
+        progress.next(appliedSeq);
+        if (!progress.ok()) {
+            rollbackTransaction(handle);
+            return false;
+        }
+
+        for (const JournaledAttempt* attempt : attempts) {
+            if (attempt->seq <= appliedSeq) continue;
+
+            ScoreChange change;
+            bool found = false;
+            if (!liveQuizzes.count(attempt->quizId)) {
+                found = false;
+            } else if (!applyAttempt(handle, attempt->studentId, attempt->quizId, attempt->score,
+                                     attempt->submittedAt, &change, &found)) {
+                if (mysql_errno(handle) != 1452) { // ER_NO_REFERENCED_ROW_2: quiz is gone
+                    rollbackTransaction(handle);
+                    return false;
+                }
+                found = false;
+            }
+            if (!found) {
+                cerr << "Dropping journaled attempt " << attempt->seq << " by student "
+                     << attempt->studentId << " at quiz " << attempt->quizId << endl;
+            } else if (change.newScore != change.oldScore) {
+                changes.push_back(change);
+            }
+        }
+
+        query = "UPDATE journal_progress SET applied_seq = " + to_string(attempts.back()->seq) +
+               " WHERE journal_id = '" + id + "'";
+        if (runQuery(handle, query.c_str(), __func__)) {
+            cerr << "Error: " << mysql_error(handle) << endl;
+            rollbackTransaction(handle);
+            return false;
         }
+        return commitTransaction(handle);
+    }
 
-        if (question.getOptions().size() > 3) {
-            query += "'" + escapeString(question.getOptions()[3]) + "', ";
-        } else {
-            query += "NULL, ";
+    // Saves an attempt. With a journal it counts as saved once it is on
+    // local disk and reaches MySQL in the background; without one, or if the
+    // journal can't be written, it goes straight to MySQL.
+    bool submitQuizAttempt(int studentId, int quizId, int score) {
+        if (journal && journal->append(studentId, quizId, score)) return true;
+        return recordQuizAttempt(studentId, quizId, score);
+    }
+
+    // Attempts by this student still on their way from the journal to MySQL
+    size_t pendingAttempts(int studentId) {
+        return journal ? journal->pendingFor(studentId) : 0;
+    }
+
+    // Records a quiz attempt in its own transaction
+    bool recordQuizAttempt(int studentId, int quizId, int score, int* scoreDelta = nullptr) {
+        MYSQL* handle = shardConns[shardOfUser(studentId)];
+        if (!beginTransaction(handle)) return false;
+
+        ScoreChange change;
+        bool found = false;
+        if (!applyAttempt(handle, studentId, quizId, score, static_cast<int64_t>(microsSinceEpoch()),
+                          &change, &found) || !found) {
+            rollbackTransaction(handle);
+            return false; // Database error or no such student
         }
 
-        query += to_string(question.getCorrectOption()) + ")";
+        if (!commitTransaction(handle)) return false;
 
-        if (mysql_query(conn, query.c_str())) {
-            cerr << "Error: " << mysql_error(conn) << endl;
+        if (change.newScore != change.oldScore) scores->publish(change);
+        if (scoreDelta) *scoreDelta = change.newScore - change.oldScore;
+        return true;
+    }
+
+    // Saves the outcome of an adaptive attempt, replacing any earlier one
+    // at the same quiz. It is an estimate, so it stays out of
+    // student_quizzes, users.score and the leaderboards.
+    bool recordAdaptiveAttempt(int studentId, int quizId, double ability, double expectedScore,
+                               int questionsAnswered) {
+        MYSQL* handle = shardConns[shardOfUser(studentId)];
+        string query = "INSERT INTO adaptive_attempts (student_id, quiz_id, ability, expected_score, "
+                      "questions_answered) VALUES (" + to_string(studentId) + ", " + to_string(quizId) + ", " +
+                      to_string(ability) + ", " + to_string(expectedScore) + ", " +
+                      to_string(questionsAnswered) + ") ON DUPLICATE KEY UPDATE ability = VALUES(ability), "
+                      "expected_score = VALUES(expected_score), questions_answered = VALUES(questions_answered), "
+                      "completed_at = CURRENT_TIMESTAMP";
+        noteWrite();
+        if (runQuery(handle, query.c_str(), __func__)) {
+            cerr << "Error: " << mysql_error(handle) << endl;
             return false;
         }
         return true;
     }
 
-    bool recordQuizAttempt(int studentId, int quizId, int score) {
-        string query = "INSERT INTO student_quizzes (student_id, quiz_id, score) VALUES (" +
-                      to_string(studentId) + ", " +
-                      to_string(quizId) + ", " +
-                      to_string(score) + ") "
-                      "ON DUPLICATE KEY UPDATE score = VALUES(score)";
+    ScoreFeed& scoreFeed() { return *scores; }
 
-        if (mysql_query(conn, query.c_str())) {
-            cerr << "Error: " << mysql_error(conn) << endl;
-            return false;
+private:
+    // Runs a poller query on a shard without tracing it
+    MYSQL_RES* pollShard(size_t shard, const string& query) {
+        MYSQL* handle = pollConns[shard];
+        if (mysql_query(handle, query.c_str())) {
+            cerr << "MySQL Query Error: " << mysql_error(handle) << endl;
+            return nullptr;
         }
+        return trackResult(mysql_store_result(handle));
+    }
 
-        // Update user's total score
-        query = "UPDATE users SET score = score + " + to_string(score) +
-               " WHERE id = " + to_string(studentId);
+    // Drops the poller's connections; the next poll opens new ones and
+    // starts over from about then
+    void closePollConnections() {
+        for (MYSQL* handle : pollConns) {
+            mysql_close(handle);
+        }
+        pollConns.clear();
+        scoreWatermarks.clear();
+    }
 
-        if (mysql_query(conn, query.c_str())) {
-            cerr << "Error: " << mysql_error(conn) << endl;
+    // Starts reading score_changes from about now. Rows of the last 10
+    // seconds are published again, which live leaderboards tolerate.
+    void resetScoreSync() {
+        scoreWatermarks.assign(pollConns.size(), 0);
+        scoreSeen.assign(pollConns.size(), set<unsigned long long>());
+        for (size_t shard = 0; shard < pollConns.size(); ++shard) {
+            RowReader<unsigned long long>(pollShard(shard,
+                "SELECT COALESCE(MAX(seq), 0) FROM score_changes WHERE changed_at < NOW() - INTERVAL 10 SECOND"))
+                .next(scoreWatermarks[shard]);
+            if (connectionLost(pollConns[shard])) {
+                closePollConnections();
+                return;
+            }
+        }
+        lastScoreSync = chrono::steady_clock::now();
+    }
+
+    // Publishes the score changes other processes have logged since the
+    // last call. As in syncCatalog, rows stay above a shard's watermark
+    // until they are 10 seconds old, since a lower seq can commit after a
+    // higher one. With nothing new this is one index range read per shard.
+    void pollScoreChanges() {
+        if (pollConns.empty()) {
+            for (size_t shard = 0; shard < shardConns.size(); ++shard) {
+                MYSQL* handle = connect(shard == 0 ? config.primary : config.shards[shard - 1]);
+                if (!handle) break;
+                pollConns.push_back(handle);
+            }
+            if (pollConns.size() < shardConns.size()) {
+                closePollConnections();
+                return;
+            }
+        }
+        if (scoreWatermarks.empty() || chrono::steady_clock::now() - lastScoreSync > chrono::hours(12)) {
+            resetScoreSync();
+            return;
+        }
+        lastScoreSync = chrono::steady_clock::now();
+
+        for (size_t shard = 0; shard < pollConns.size(); ++shard) {
+            string query = "SELECT seq, student_id, old_score, new_score, "
+                          "changed_at < NOW() - INTERVAL 10 SECOND FROM score_changes WHERE seq > " +
+                          to_string(scoreWatermarks[shard]) + " AND origin <> " + to_string(scores->origin()) +
+                          " ORDER BY seq LIMIT 1000";
+            RowReader<unsigned long long, int, int, int, int> rows(pollShard(shard, query));
+            unsigned long long seq;
+            ScoreChange change;
+            int settled;
+            bool settledSoFar = true;
+            while (rows.next(seq, change.studentId, change.oldScore, change.newScore, settled)) {
+                if (!scoreSeen[shard].count(seq)) scores->publish(change);
+                if (settledSoFar && settled) {
+                    scoreWatermarks[shard] = seq;
+                } else {
+                    settledSoFar = false;
+                    scoreSeen[shard].insert(seq);
+                }
+            }
+            if (connectionLost(pollConns[shard])) {
+                closePollConnections();
+                return;
+            }
+            set<unsigned long long>& seen = scoreSeen[shard];
+            seen.erase(seen.begin(), seen.upper_bound(scoreWatermarks[shard]));
+        }
+    }
+
+    // The score poller thread: once a second while anyone in this process
+    // watches the feed. Idle, it forgets its position, so the next watcher
+    // starts from about then instead of catching up.
+    void runScorePoller() {
+        mysql_thread_init();
+        unique_lock<mutex> lock(pollerMutex);
+        while (!pollerStopping) {
+            lock.unlock();
+            if (scores->watched()) {
+                pollScoreChanges();
+            } else {
+                scoreWatermarks.clear();
+            }
+            lock.lock();
+            pollerWake.wait_for(lock, chrono::seconds(1), [this] { return pollerStopping; });
+        }
+        lock.unlock();
+        closePollConnections();
+        mysql_thread_end();
+    }
+
+public:
+    int getStudentScore(int studentId) {
+        string query = "SELECT score FROM users WHERE id = " + to_string(studentId);
+        int score = 0;
+        RowReader<int>(readShard(shardOfUser(studentId), query, __func__)).next(score);
+        return score;
+    }
+
+    // Offline reconciliation: recomputes every student's total from their
+    // per-quiz scores in a single set-based statement per shard.
+    bool reconcileStudentScores() {
+        string query = "UPDATE users u "
+                      "LEFT JOIN (SELECT student_id, SUM(score) AS total "
+                      "FROM student_quizzes GROUP BY student_id) t ON t.student_id = u.id "
+                      "SET u.score = COALESCE(t.total, 0) "
+                      "WHERE u.role = 'student'";
+
+        noteWrite();
+        unsigned long long corrected = 0;
+        for (MYSQL* handle : shardConns) {
+            if (runQuery(handle, query.c_str(), __func__)) {
+                cerr << "Error reconciling scores: " << mysql_error(handle) << endl;
+                return false;
+            }
+            corrected += mysql_affected_rows(handle);
+        }
+
+        cout << "Reconciled scores, " << corrected << " student(s) corrected.\n";
+        return true;
+    }
+
+    // Offline job: drops change log rows older than a day. A process that
+    // goes 12 hours without syncing starts over instead of reading the log,
+    // so nothing still needs them.
+    bool pruneChangeLogs() {
+        noteWrite();
+        if (runQuery(conn, "DELETE FROM catalog_changes WHERE changed_at < NOW() - INTERVAL 1 DAY", __func__)) {
+            cerr << "Error pruning catalog changes: " << mysql_error(conn) << endl;
             return false;
         }
+        cout << "Pruned " << mysql_affected_rows(conn) << " catalog change(s).\n";
 
+        unsigned long long pruned = 0;
+        for (MYSQL* handle : shardConns) {
+            if (runQuery(handle, "DELETE FROM score_changes WHERE changed_at < NOW() - INTERVAL 1 DAY", __func__)) {
+                cerr << "Error pruning score changes: " << mysql_error(handle) << endl;
+                return false;
+            }
+            pruned += mysql_affected_rows(handle);
+        }
+        cout << "Pruned " << pruned << " score change(s).\n";
         return true;
     }
 
     string escapeString(const string& input) {
+        return escapeString(conn, input);
+    }
+
+    string escapeString(MYSQL* handle, const string& input) {
+        MemoryTagScope scope(TagQueries);
         char* output = new char[input.length() * 2 + 1];
-        mysql_real_escape_string(conn, output, input.c_str(), input.length());
+        mysql_real_escape_string(handle, output, input.c_str(), input.length());
         string result(output);
         delete[] output;
         return result;
@@ -452,133 +5227,865 @@ bool registerUser(const string& username, const string& password, const string&
             query += " AND role = '" + escapeString(role) + "'";
         }
 
-        if (mysql_query(conn, query.c_str())) {
-            cerr << "Error deleting user: " << mysql_error(conn) << endl;
+        MYSQL* handle = shardConns[shardOfUser(userId)];
+        noteWrite();
+        if (runQuery(handle, query.c_str(), __func__)) {
+            cerr << "Error deleting user: " << mysql_error(handle) << endl;
             return false;
         }
 
-        if (mysql_affected_rows(conn) == 0) {
+        if (mysql_affected_rows(handle) == 0) {
             return false; // No such user+role found
         }
         return true;
     }
     
     vector<UserRole> getUserRoles(const string& username) {
-        vector<UserRole> roles;
         string query = "SELECT id, role FROM users WHERE username = '" + 
                         escapeString(username) + "'";
     
-        MYSQL_RES* result = executeQueryWithResult(query);
-        if (result) {
-            MYSQL_ROW row;
-            while ((row = mysql_fetch_row(result))) {
-                roles.push_back({stoi(row[0]), row[1]});
-            }
-            mysql_free_result(result);
-        }
-        return roles;
+        return UserRoleRows(readShard(shardOfUsername(username), query, __func__)).all<UserRole>();
     }
 
+    // Roles of this username whose stored hash matches the password. All
+    // rows are verified in parallel on the hashing pool; rows still holding
+    // a plain password are upgraded to a salted hash on a successful match.
     vector<UserRole> getUserRoles(const string& username, const string& password) {
         vector<UserRole> roles;
-        string query = "SELECT id, role FROM users WHERE username = '" + 
-                      escapeString(username) + "' AND password = '" + 
-                      escapeString(password) + "'";
+        size_t shard = shardOfUsername(username);
+        string query = "SELECT id, role, password FROM users WHERE username = '" +
+                      escapeString(username) + "'";
     
-        MYSQL_RES* result = executeQueryWithResult(query);
-        if (result) {
-            MYSQL_ROW row;
-            while ((row = mysql_fetch_row(result))) {
-                roles.push_back({stoi(row[0]), row[1]});
+        RowReader<int, string, string> rows(readShard(shard, query, __func__));
+        vector<UserRole> candidates;
+        vector<bool> legacy;
+        vector<future<bool>> checks;
+        UserRole candidate;
+        string stored;
+        while (rows.next(candidate.id, candidate.role, stored)) {
+            candidates.push_back(candidate);
+            legacy.push_back(!PasswordHasher::isHashed(stored));
+            checks.push_back(passwordHasher->verify(password, stored));
+        }
+
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            if (!checks[i].get()) continue;
+            roles.push_back(candidates[i]);
+
+            if (legacy[i]) {
+                string upgrade = "UPDATE users SET password = '" +
+                                escapeString(passwordHasher->hash(password).get()) +
+                                "' WHERE id = " + to_string(candidates[i].id);
+                noteWrite();
+                if (runQuery(shardConns[shard], upgrade.c_str(), __func__)) {
+                    cerr << "Error upgrading password hash: " << mysql_error(shardConns[shard]) << endl;
+                }
             }
-            mysql_free_result(result);
         }
         return roles;
     }
 
 vector<UserRole> getAllRolesForUser(const string& username) {
-    vector<UserRole> roles;
     string query = "SELECT id, role FROM users WHERE username = '" + 
                  escapeString(username) + "'";
     
-    MYSQL_RES* result = executeQueryWithResult(query);
-    if (result) {
-        MYSQL_ROW row;
-        while ((row = mysql_fetch_row(result))) {
-            roles.push_back({stoi(row[0]), row[1]});
+    return UserRoleRows(readShard(shardOfUsername(username), query, __func__)).all<UserRole>();
+}
+
+// Non-blocking variant of getUserRoles(username); rows are decoded when the
+// caller collects the future. The async executors only reach shard 0, so
+// users on other shards are looked up when the future is collected.
+future<vector<UserRole>> getUserRolesAsync(const string& username) {
+    if (shardOfUsername(username) != 0) {
+        return async(launch::deferred, [this, username] { return getUserRoles(username); });
+    }
+
+    string query = "SELECT id, role FROM users WHERE username = '" +
+                  escapeString(username) + "'";
+
+    return async(launch::deferred, [](future<AsyncResult> pending) {
+        AsyncResult outcome = pending.get();
+        if (!outcome.ok) {
+            cerr << "MySQL Query Error: " << outcome.error << endl;
+            return vector<UserRole>();
         }
-        mysql_free_result(result);
+        return UserRoleRows(move(outcome.result)).all<UserRole>();
+    }, readAsync(query, __func__));
+}
+
+// Non-blocking variant of getStudentScore, with the same shard caveat
+future<int> getStudentScoreAsync(int studentId) {
+    if (shardOfUser(studentId) != 0) {
+        return async(launch::deferred, [this, studentId] { return getStudentScore(studentId); });
     }
-    return roles;
+
+    string query = "SELECT score FROM users WHERE id = " + to_string(studentId);
+
+    return async(launch::deferred, [](future<AsyncResult> pending) {
+        AsyncResult outcome = pending.get();
+        int score = 0;
+        if (outcome.ok) RowReader<int>(move(outcome.result)).next(score);
+        return score;
+    }, readAsync(query, __func__));
 }
 
-bool verifyPassword(const string& username, const string& password) {
-    string query = "SELECT 1 FROM users WHERE username = '" +
-                  escapeString(username) + "' AND password = '" +
-                  escapeString(password) + "' LIMIT 1";
+// Non-blocking variant of deleteQuestion. The delete and its catalog_changes
+// entry commit together on an async connection; the indexes and caches are
+// updated when the caller collects the future, and only if they did.
+future<bool> deleteQuestionAsync(int questionId) {
+    vector<string> statements = {
+        "DELETE FROM questions WHERE id = " + to_string(questionId),
+        catalogChangesInsert({{0, questionId, true}}, 0, 1)
+    };
 
-    MYSQL_RES* result = executeQueryWithResult(query);
-    if (result) {
-        bool valid = mysql_num_rows(result) > 0;
-        mysql_free_result(result);
-        return valid;
-    }
-    return false;
+    return async(launch::deferred, [this, questionId](future<AsyncResult> pending) {
+        AsyncResult outcome = pending.get();
+        if (!outcome.ok) {
+            cerr << "Error deleting question: " << outcome.error << endl;
+            return false;
+        }
+        searchIndex.removeQuestion(questionId);
+        duplicateDetector.remove(questionId);
+        uncacheQuestions({questionId});
+        return true;
+    }, writeTransactionAsync(statements, __func__));
+}
+
+bool verifyPassword(const string& username, const string& password) {
+    return !getUserRoles(username, password).empty();
 }
 
 bool deleteQuiz(int quizId) {
     string query = "DELETE FROM quizzes WHERE id = " + to_string(quizId);
-    if (mysql_query(conn, query.c_str())) {
+    vector<ScoreChange> changes;
+    if (!beginTransaction()) return false;
+    if (!removeQuizScores(conn, {quizId}, changes)) {
+        rollbackTransaction();
+        return false;
+    }
+    if (runQuery(conn, query.c_str(), __func__)) {
         cerr << "Error deleting quiz: " << mysql_error(conn) << endl;
+        rollbackTransaction();
+        return false;
+    }
+    if (!logCatalogChanges(conn, {{quizId, 0, true}}) || !commitTransaction()) {
+        rollbackTransaction();
         return false;
     }
+    for (const auto& change : changes) {
+        scores->publish(change);
+    }
+    purgeQuizAttempts({quizId});
+    searchIndex.removeQuiz(quizId);
+    duplicateDetector.removeQuiz(quizId);
+    uncacheQuizzes({quizId});
     return true;
 }
 
 bool deleteQuestion(int questionId) {
     string query = "DELETE FROM questions WHERE id = " + to_string(questionId);
-    if (mysql_query(conn, query.c_str())) {
+    if (!beginTransaction()) return false;
+    if (runQuery(conn, query.c_str(), __func__)) {
         cerr << "Error deleting question: " << mysql_error(conn) << endl;
+        rollbackTransaction();
+        return false;
+    }
+    if (!logCatalogChanges(conn, {{0, questionId, true}}) || !commitTransaction()) {
+        rollbackTransaction();
+        return false;
+    }
+    searchIndex.removeQuestion(questionId);
+    duplicateDetector.remove(questionId);
+    uncacheQuestions({questionId});
+    return true;
+}
+
+// Batch operations: one DELETE ... WHERE id IN (...) per chunk of IDs, all
+// chunks inside a single transaction on one shard. Return the number of rows
+// deleted or -1 on error (nothing is deleted in that case). beforeDelete and
+// beforeCommit, if given, run first and last inside the transaction and roll
+// it back by returning false.
+int deleteRowsById(const string& table, const vector<int>& ids, size_t shard = 0,
+                   const function<bool(MYSQL*)>& beforeCommit = nullptr,
+                   const function<bool(MYSQL*)>& beforeDelete = nullptr) {
+    const size_t chunkSize = 1000;
+    MYSQL* handle = shardConns[shard];
+    if (ids.empty()) return 0;
+    if (!beginTransaction(handle)) return -1;
+    if (beforeDelete && !beforeDelete(handle)) {
+        rollbackTransaction(handle);
+        return -1;
+    }
+
+    long long deleted = 0;
+    for (size_t begin = 0; begin < ids.size(); begin += chunkSize) {
+        size_t end = min(ids.size(), begin + chunkSize);
+        string query = "DELETE FROM " + table + " WHERE id IN (";
+        for (size_t i = begin; i < end; ++i) {
+            if (i > begin) query += ",";
+            query += to_string(ids[i]);
+        }
+        query += ")";
+
+        if (runQuery(handle, query.c_str(), __func__)) {
+            cerr << "Error deleting from " << table << ": " << mysql_error(handle) << endl;
+            rollbackTransaction(handle);
+            return -1;
+        }
+        deleted += mysql_affected_rows(handle);
+    }
+
+    if (beforeCommit && !beforeCommit(handle)) {
+        rollbackTransaction(handle);
+        return -1;
+    }
+    if (!commitTransaction(handle)) return -1;
+    return static_cast<int>(deleted);
+}
+
+// Users are grouped by shard and each shard commits separately, so a
+// failure part way leaves the earlier shards' deletions in place
+int deleteUserAccounts(const vector<UserRole>& accounts) {
+    vector<vector<int>> idsByShard(shardConns.size());
+    for (const auto& account : accounts) {
+        idsByShard[shardOfUser(account.id)].push_back(account.id);
+    }
+
+    int deleted = 0;
+    for (size_t shard = 0; shard < idsByShard.size(); ++shard) {
+        int count = deleteRowsById("users", idsByShard[shard], shard);
+        if (count < 0) return -1;
+        deleted += count;
+    }
+    return deleted;
+}
+
+int deleteQuizzes(const vector<int>& quizIds) {
+    vector<CatalogChange> changes;
+    for (int quizId : quizIds) {
+        changes.push_back({quizId, 0, true});
+    }
+    vector<ScoreChange> scoreChanges;
+    int deleted = deleteRowsById("quizzes", quizIds, 0,
+                                 [&](MYSQL* handle) { return logCatalogChanges(handle, changes); },
+                                 [&](MYSQL* handle) { return removeQuizScores(handle, quizIds, scoreChanges); });
+    if (deleted >= 0) {
+        for (const auto& change : scoreChanges) {
+            scores->publish(change);
+        }
+    }
+    if (deleted > 0) {
+        purgeQuizAttempts(quizIds);
+        for (int quizId : quizIds) {
+            searchIndex.removeQuiz(quizId);
+            duplicateDetector.removeQuiz(quizId);
+        }
+        uncacheQuizzes(quizIds);
+    }
+    return deleted;
+}
+
+int deleteQuestions(const vector<int>& questionIds) {
+    vector<CatalogChange> changes;
+    for (int questionId : questionIds) {
+        changes.push_back({0, questionId, true});
+    }
+    int deleted = deleteRowsById("questions", questionIds, 0,
+                                 [&](MYSQL* handle) { return logCatalogChanges(handle, changes); });
+    if (deleted > 0) {
+        for (int questionId : questionIds) {
+            searchIndex.removeQuestion(questionId);
+            duplicateDetector.remove(questionId);
+        }
+        uncacheQuestions(questionIds);
+    }
+    return deleted;
+}
+
+// Escapes LIKE wildcards so the text is matched literally as a substring
+string containsPattern(const string& text) {
+    string literal;
+    for (char c : text) {
+        if (c == '%' || c == '_' || c == '\\') literal += '\\';
+        literal += c;
+    }
+    return "'%" + escapeString(literal) + "%'";
+}
+
+// IDs of the rows whose column contains the text, read from the primary
+bool idsMatching(const string& table, const string& column, const string& text, vector<int>& ids) {
+    string select = "SELECT id FROM " + table + " WHERE " + column + " LIKE " + containsPattern(text);
+    MYSQL_RES* result = executeQueryWithResult(select, __func__);
+    if (!result) return false;
+    RowReader<int> rows(result);
+    int id;
+    while (rows.next(id)) {
+        ids.push_back(id);
+    }
+    return rows.ok();
+}
+
+// The IDs are looked up first so that other shards can drop attempts at the
+// deleted quizzes and each deletion is logged for other processes
+int deleteQuizzesMatching(const string& titleText) {
+    vector<int> quizIds;
+    if (!idsMatching("quizzes", "title", titleText, quizIds)) return -1;
+    return deleteQuizzes(quizIds);
+}
+
+int deleteQuestionsMatching(const string& text) {
+    vector<int> questionIds;
+    if (!idsMatching("questions", "text", text, questionIds)) return -1;
+    return deleteQuestions(questionIds);
+}
+
+// Streams every quiz and question into the search index and the
+// near-duplicate detector
+bool loadQuestionBank() {
+    MemoryTagScope scope(TagCatalog);
+    searchIndex.clear();
+    duplicateDetector.clear();
+    MYSQL* handle = readConnection();
+
+    if (runQuery(handle, "SELECT id, title, description FROM quizzes", __func__)) {
+        cerr << "MySQL Query Error: " << mysql_error(handle) << endl;
+        return false;
+    }
+    // Unbuffered: each reader must be gone before the next query is sent
+    {
+        RowReader<int, string, string> quizzes(mysql_use_result(handle));
+        int id;
+        string title, description;
+        while (quizzes.next(id, title, description)) {
+            searchIndex.addQuiz(id, title, description);
+        }
+        if (!quizzes.ok()) return false;
+    }
+
+    if (runQuery(handle, "SELECT id, quiz_id, text, option1, option2, option3, option4 FROM questions", __func__)) {
+        cerr << "MySQL Query Error: " << mysql_error(handle) << endl;
         return false;
     }
-    return true;
+    {
+        RowReader<int, int, string, Nullable<string>, Nullable<string>, Nullable<string>, Nullable<string>>
+            questions(mysql_use_result(handle));
+        int questionId, quizId;
+        string text;
+        Nullable<string> columns[4];
+        while (questions.next(questionId, quizId, text, columns[0], columns[1], columns[2], columns[3])) {
+            vector<string> options;
+            for (const auto& column : columns) {
+                if (column.present) options.push_back(column.value);
+            }
+            searchIndex.addQuestion(questionId, quizId, text, options);
+            duplicateDetector.add(questionId, quizId, text, options);
+        }
+        if (!questions.ok()) return false;
+    }
+
+    bankIndexesReady = true;
+    return true;
+}
+
+vector<SearchIndex::Hit> search(const string& query, SearchIndex::Kind kind, size_t limit) {
+    syncCatalog();
+    if (!bankIndexesReady && !loadQuestionBank()) {
+        return vector<SearchIndex::Hit>();
+    }
+    return searchIndex.search(query, kind, limit);
+}
+
+// Existing questions whose estimated similarity to the candidate is at
+// least the threshold, most similar first
+vector<NearDuplicateDetector::Match> findNearDuplicates(const string& text, const vector<string>& options,
+                                                        double threshold = 0.8) {
+    syncCatalog();
+    if (!bankIndexesReady && !loadQuestionBank()) {
+        return vector<NearDuplicateDetector::Match>();
+    }
+    return duplicateDetector.findSimilar(text, options, threshold);
+}
+
+vector<NearDuplicateDetector::DuplicatePair> nearDuplicateReport(double threshold = 0.8) {
+    syncCatalog();
+    if (!bankIndexesReady && !loadQuestionBank()) {
+        return vector<NearDuplicateDetector::DuplicatePair>();
+    }
+    return duplicateDetector.findAllPairs(threshold);
+}
+
+// Display the top students across all shards and the rank of the current
+// student. Each shard returns its own top K, which are merged; the rank is
+// one more than the number of students ahead on every shard, using the same
+// (score DESC, username ASC) order.
+void displayStudentRanks(int currentStudentId, int topK = 10) {
+    printLeaderboard("Student Leaderboard", "users u", "u.role = 'student'", "u.score", currentStudentId, topK);
+}
+
+// Leaderboard for one quiz, or all quizzes when quizId is 0, over all time or
+// the current day, week or term ("day", "week", "term"). Windowed boards and
+// single quizzes read only the matching bucket or the quiz's attempts.
+void displayLeaderboard(const string& heading, const string& period, int quizId, int currentStudentId,
+                        int topK = 10) {
+    if (period.empty() && quizId == 0) {
+        displayStudentRanks(currentStudentId, topK);
+    } else if (period.empty()) {
+        printLeaderboard(heading, "student_quizzes b JOIN users u ON u.id = b.student_id",
+                         "b.quiz_id = " + to_string(quizId), "b.score", currentStudentId, topK);
+    } else {
+        printLeaderboard(heading, "leaderboard_buckets b JOIN users u ON u.id = b.student_id",
+                         "b.period = '" + period + "' AND b.period_start = " + periodStartSql(period, "NOW()") +
+                         " AND b.quiz_id = " + to_string(quizId),
+                         "b.score", currentStudentId, topK);
+    }
+}
+
+// Top students overall, as shown by displayStudentRanks
+vector<LeaderboardEntry> topStudents(int topK) {
+    return leaderboardTop("users u", "u.role = 'student'", "u.score", topK);
+}
+
+// A student's overall rank and total; 0 if there is no such student
+long long studentRank(int studentId, int* score) {
+    return leaderboardRank("users u", "u.role = 'student'", "u.score", studentId, score);
+}
+
+// Shared by the leaderboards above: students in from (aliasing users as u)
+// that match where, ranked by the score expression
+vector<LeaderboardEntry> leaderboardTop(const string& from, const string& where, const string& score, int topK) {
+    vector<LeaderboardEntry> leaders;
+    string query = "SELECT u.id, u.username, " + score + " FROM " + from + " WHERE " + where +
+                  " ORDER BY " + score + " DESC, u.username ASC LIMIT " + to_string(topK);
+    for (auto& result : scatterRead(query, __func__)) {
+        vector<LeaderboardEntry> shardLeaders = RowReader<int, string, int>(move(result)).all<LeaderboardEntry>();
+        leaders.insert(leaders.end(), shardLeaders.begin(), shardLeaders.end());
+    }
+    sort(leaders.begin(), leaders.end(), [](const LeaderboardEntry& a, const LeaderboardEntry& b) {
+        return a.score != b.score ? a.score > b.score : a.username < b.username;
+    });
+    if (leaders.size() > static_cast<size_t>(topK)) leaders.resize(topK);
+    return leaders;
+}
+
+long long leaderboardRank(const string& from, const string& where, const string& score, int studentId,
+                          int* studentScore) {
+    string query = "SELECT u.username, " + score + " FROM " + from + " WHERE " + where +
+                  " AND u.id = " + to_string(studentId);
+    string username;
+    if (!RowReader<string, int>(readShard(shardOfUser(studentId), query, __func__)).next(username, *studentScore)) {
+        return 0;
+    }
+    query = "SELECT COUNT(*) FROM " + from + " WHERE " + where + " AND (" + score + " > " + to_string(*studentScore) +
+           " OR (" + score + " = " + to_string(*studentScore) + " AND u.username < '" + escapeString(username) + "'))";
+
+    long long ahead = 0;
+    for (auto& count : scatterRead(query, __func__)) {
+        long long shardAhead;
+        if (RowReader<long long>(move(count)).next(shardAhead)) ahead += shardAhead;
+    }
+    return ahead + 1;
+}
+
+void printLeaderboard(const string& heading, const string& from, const string& where, const string& score,
+                      int currentStudentId, int topK) {
+    vector<LeaderboardEntry> leaders = leaderboardTop(from, where, score, topK);
+    cout << "\n--- " << heading << " ---\n";
+    if (leaders.empty()) {
+        cout << "No scores recorded yet.\n";
+        return;
+    }
+    cout << "Rank\tUsername\tScore\n";
+    for (size_t i = 0; i < leaders.size(); ++i) {
+        cout << i + 1 << "\t" << leaders[i].username << "\t\t" << leaders[i].score << "\n";
+    }
+
+    int studentScore;
+    long long rank = leaderboardRank(from, where, score, currentStudentId, &studentScore);
+    if (rank == 0) {
+        cout << "\nYou are not ranked (no score recorded yet).\n";
+        return;
+    }
+    cout << "\nYour rank is: " << rank << "\n";
+}
+
+};
+
+// Parses "3, 7 10-12" into {3, 7, 10, 11, 12}; returns false on bad input,
+// including reversed ranges and lists of more than maxIdListSize IDs
+const size_t maxIdListSize = 100000;
+
+bool parseIdList(const string& text, vector<int>& ids) {
+    // Whole token must be a number; stoi alone accepts "3x"
+    auto parseId = [](const string& token, int& id) {
+        size_t end = 0;
+        try {
+            id = stoi(token, &end);
+        } catch (const exception&) {
+            return false;
+        }
+        return end == token.size();
+    };
+
+    string token;
+    for (size_t i = 0; i <= text.size(); ++i) {
+        char c = i < text.size() ? text[i] : ' ';
+        if (c != ' ' && c != ',') {
+            token += c;
+            continue;
+        }
+        if (token.empty()) continue;
+
+        size_t dash = token.find('-', 1);
+        int first, last;
+        if (dash == string::npos) {
+            if (!parseId(token, first)) return false;
+            last = first;
+        } else if (!parseId(token.substr(0, dash), first) || !parseId(token.substr(dash + 1), last) ||
+                   first > last) {
+            return false;
+        }
+        if (static_cast<long long>(last) - first + 1 > static_cast<long long>(maxIdListSize - ids.size())) {
+            return false;
+        }
+        for (long long id = first; id <= last; ++id) {
+            ids.push_back(static_cast<int>(id));
+        }
+        token.clear();
+    }
+    return !ids.empty();
+}
+
+// Shared flow for the bulk delete menu entries. Accepts either a list of
+// IDs or "match:<text>" to delete every row whose text contains <text>.
+void bulkDeleteFlow(const string& what, int (DatabaseManager::*deleteIds)(const vector<int>&),
+                    int (DatabaseManager::*deleteMatching)(const string&), DatabaseManager& db) {
+    cout << "Enter " << what << " IDs (e.g. 3, 7 10-12) or match:<text>: ";
+    string input;
+    getline(cin, input);
+
+    int deleted;
+    if (input.compare(0, 6, "match:") == 0 && input.size() > 6) {
+        string text = input.substr(6);
+        char confirm;
+        cout << "Delete every " << what << " containing '" << text << "'? (y/n): ";
+        cin >> confirm;
+        cin.ignore();
+        if (confirm != 'y' && confirm != 'Y') return;
+        deleted = (db.*deleteMatching)(text);
+    } else {
+        vector<int> ids;
+        if (!parseIdList(input, ids)) {
+            cout << "Invalid ID list.\n";
+            return;
+        }
+        deleted = (db.*deleteIds)(ids);
+    }
+
+    if (deleted < 0) {
+        cout << "Bulk delete failed, nothing was deleted.\n";
+    } else {
+        cout << deleted << " " << what << "(s) deleted.\n";
+    }
+}
+
+// Rows shown per screen by the paged menus
+const int menuPageSize = 10;
+
+// Pages through a list with keyset cursors: fetchPage(afterId, limit) loads
+// the rows after a cursor, printItem(number, item) shows one. Only one page
+// is held in memory. Returns the selected item's ID, or -1 if the user goes
+// back (or selectable is false).
+template <typename Item, typename FetchPage, typename PrintItem>
+int pageThrough(const string& heading, const string& emptyMessage, bool selectable,
+                FetchPage fetchPage, PrintItem printItem) {
+    vector<int> pageStarts(1, 0);  // Cursor each visited page started after
+    while (true) {
+        // One extra row tells us whether there is a next page
+        vector<Item> page = fetchPage(pageStarts.back(), menuPageSize + 1);
+        bool hasNext = page.size() > static_cast<size_t>(menuPageSize);
+        if (hasNext) page.pop_back();
+
+        if (page.empty()) {
+            cout << "\n" << emptyMessage << "\n";
+            return -1;
+        }
+
+        cout << "\n" << heading << " (page " << pageStarts.size() << "):\n";
+        for (size_t i = 0; i < page.size(); ++i) {
+            printItem(i + 1, page[i]);
+        }
+
+        cout << "\n";
+        if (selectable) cout << "Enter 1-" << page.size() << " to select, ";
+        if (hasNext) cout << "n for next page, ";
+        if (pageStarts.size() > 1) cout << "p for previous page, ";
+        cout << "q to go back: ";
+
+        string input;
+        cin >> input;
+        cin.ignore(numeric_limits<streamsize>::max(), '\n');
+
+        if (input == "n" && hasNext) {
+            pageStarts.push_back(page.back().getId());
+        } else if (input == "p" && pageStarts.size() > 1) {
+            pageStarts.pop_back();
+        } else if (input == "q") {
+            return -1;
+        } else if (selectable && !input.empty() && isdigit(static_cast<unsigned char>(input[0]))) {
+            int choice = atoi(input.c_str());
+            if (choice >= 1 && choice <= static_cast<int>(page.size())) {
+                return page[choice - 1].getId();
+            }
+            cout << "Invalid choice.\n";
+        } else {
+            cout << "Invalid choice.\n";
+        }
+    }
+}
+
+enum QuizFilter { AllQuizzes, NotAttempted, CompletedOnly };
+
+QuizFilter askQuizFilter() {
+    cout << "\nShow: 1. All quizzes  2. Not attempted yet  3. Completed\n";
+    cout << "Enter your choice: ";
+    int choice;
+    cin >> choice;
+    cin.ignore();
+    return choice == 2 ? NotAttempted : choice == 3 ? CompletedOnly : AllQuizzes;
+}
+
+// One keyset page of quizzes, filtered by a student's completed set.
+// Completed quizzes are looked up directly by the IDs in the set; quizzes
+// not attempted are catalog pages with completed ones dropped, read on
+// until the page is full.
+vector<Quiz> fetchQuizPage(DatabaseManager& db, const QuizIdSet* completed, QuizFilter filter,
+                           int afterId, int limit) {
+    if (!completed || filter == AllQuizzes) return db.getQuizPage(afterId, limit);
+
+    vector<Quiz> page;
+    while (page.size() < static_cast<size_t>(limit)) {
+        vector<Quiz> batch;
+        bool exhausted;
+        if (filter == CompletedOnly) {
+            vector<int> ids = completed->idsAfter(afterId, limit - page.size());
+            exhausted = ids.size() < limit - page.size();
+            if (!ids.empty()) afterId = ids.back();
+            batch = db.getQuizzesByIds(ids);
+        } else {
+            int batchSize = max(limit, 100);
+            batch = db.getQuizPage(afterId, batchSize);
+            exhausted = batch.size() < static_cast<size_t>(batchSize);
+            if (!batch.empty()) afterId = batch.back().getId();
+        }
+
+        for (const auto& quiz : batch) {
+            if (filter == NotAttempted && completed->contains(quiz.getId())) continue;
+            page.push_back(quiz);
+            if (page.size() == static_cast<size_t>(limit)) return page;
+        }
+        if (exhausted) break;
+    }
+    return page;
+}
+
+// Lets the user pick a quiz one page at a time; returns its ID or -1.
+// With a student's completed set, those quizzes are marked and can be
+// filtered.
+int selectQuiz(DatabaseManager& db, const string& heading, const string& emptyMessage,
+               const QuizIdSet* completed = nullptr, QuizFilter filter = AllQuizzes) {
+    return pageThrough<Quiz>(heading, emptyMessage, true,
+        [&db, completed, filter](int afterId, int limit) {
+            return fetchQuizPage(db, completed, filter, afterId, limit);
+        },
+        [completed](size_t number, const Quiz& quiz) {
+            cout << number << ". " << quiz.getTitle();
+            if (completed && completed->contains(quiz.getId())) cout << " [completed]";
+            cout << "\n";
+        });
+}
+
+// Shows every quiz with its details, one page at a time
+void browseQuizzes(DatabaseManager& db, const string& heading, const string& emptyMessage, bool showIds,
+                   const QuizIdSet* completed = nullptr, QuizFilter filter = AllQuizzes) {
+    pageThrough<Quiz>(heading, emptyMessage, false,
+        [&db, completed, filter](int afterId, int limit) {
+            return fetchQuizPage(db, completed, filter, afterId, limit);
+        },
+        [showIds, completed](size_t, const Quiz& quiz) {
+            if (showIds) cout << "\nID: " << quiz.getId();
+            if (completed && completed->contains(quiz.getId())) cout << "\n[completed]";
+            quiz.display();
+        });
+}
+
+// Shows the best search matches and lets the admin pick one.
+// Returns the chosen quiz or question ID, or -1.
+int chooseSearchHit(DatabaseManager& db, const string& term, SearchIndex::Kind kind) {
+    auto hits = db.search(term, kind, 20);
+    if (hits.empty()) {
+        cout << "No matches found.\n";
+        return -1;
+    }
+
+    cout << "\nMatches:\n";
+    for (size_t i = 0; i < hits.size(); ++i) {
+        cout << i + 1 << ". " << hits[i].text << "\n";
+    }
+
+    int choice;
+    cout << "Enter your choice (1-" << hits.size() << "): ";
+    cin >> choice;
+    cin.ignore();
+
+    if (choice >= 1 && choice <= static_cast<int>(hits.size())) {
+        return hits[choice - 1].id;
+    }
+    cout << "Invalid choice.\n";
+    return -1;
 }
 
-// Display a ranked leaderboard of all students and show the rank of the current student
-void displayStudentRanks(int currentStudentId) {
-    string query = "SELECT id, username, score FROM users WHERE role = 'student' ORDER BY score DESC, username ASC";
-    MYSQL_RES* result = executeQueryWithResult(query);
-    if (!result) return;
+// Warns when a question being entered looks like one already in the bank.
+// Returns true if the question should be added anyway.
+bool confirmNotDuplicate(DatabaseManager& db, const string& text, const vector<string>& options) {
+    auto matches = db.findNearDuplicates(text, options);
+    if (matches.empty()) return true;
 
-    MYSQL_ROW row;
-    int rank = 0;
-    int currentRank = -1;
-    cout << "\n--- Student Leaderboard ---\n";
-    cout << "Rank\tUsername\tScore\n";
+    cout << "\nThis question looks like existing question(s):\n";
+    for (size_t i = 0; i < matches.size() && i < 5; ++i) {
+        cout << "  [" << static_cast<int>(matches[i].similarity * 100) << "% similar, quiz "
+             << matches[i].quizId << "] " << matches[i].text << "\n";
+    }
 
-    while ((row = mysql_fetch_row(result))) {
-        ++rank;
-        int id = stoi(row[0]);
-        string username = row[1] ? row[1] : "";
-        int score = row[2] ? stoi(row[2]) : 0;
+    char add;
+    cout << "Add it anyway? (y/n): ";
+    cin >> add;
+    cin.ignore();
+    return add == 'y' || add == 'Y';
+}
 
-        cout << rank << "\t" << username << "\t\t" << score << "\n";
+// Asks items picked for the current ability estimate until it is precise
+// enough, fetching only the questions actually shown, and saves the final
+// estimate with the expected score over the whole quiz. Returns false when
+// the quiz has no questions.
+bool runAdaptiveQuiz(DatabaseManager& db, int studentId, int quizId) {
+    ItemBank bank = db.getItemBank(quizId);
+    if (bank.size() == 0) return false;
+
+    AbilityEstimate ability;
+    vector<char> used(bank.size(), 0);
+    vector<pair<int, bool>> responses;
+    cout << "\nStarting adaptive quiz (" << bank.size() << " questions in the bank)\n";
+
+    while (!ability.settled(responses.size())) {
+        long item = bank.nextItem(ability.theta(), used);
+        if (item < 0) break;
+        used[item] = 1;
+
+        auto question = db.getQuestionById(bank.questionId(item));
+        if (!question) continue;  // Deleted since the bank was loaded
+
+        question->display();
+        cout << "Your answer (1-" << question->getOptions().size() << "): ";
+        int choice;
+        cin >> choice;
 
-        if (id == currentStudentId) {
-            currentRank = rank;
+        bool correct = question->checkAnswer(choice);
+        if (correct) {
+            cout << "Correct!\n";
+        } else {
+            cout << "Incorrect. The correct answer was: " << question->getCorrectOption() << "\n";
         }
+        responses.push_back({question->getId(), correct});
+        ability.update(bank, item, correct);
     }
-    mysql_free_result(result);
 
-    if (currentRank != -1) {
-        cout << "\nYour rank is: " << currentRank << "\n";
-    } else {
-        cout << "\nYou are not ranked (no score recorded yet).\n";
+    double expected = bank.expectedScore(ability.theta());
+    cout << "\nQuiz completed after " << responses.size() << " question(s)! Your estimated score: "
+         << lround(expected) << "/" << bank.size() << "\n";
+    cout << "Adaptive results are estimates and don't count toward your total score.\n";
+    db.recordResponses(responses);
+    if (!db.recordAdaptiveAttempt(studentId, quizId, ability.theta(), expected,
+                                  static_cast<int>(responses.size()))) {
+        cout << "Failed to save your result.\n";
     }
+    return true;
 }
 
+// Live leaderboard: shows the top students and the student's own rank and
+// reprints them as scores change, until a key is pressed. Changes arrive in
+// batches from the score feed, so nothing is re-queried while scores hold
+// still; a batch re-reads the top list only when it touches it, and the
+// rank only when a score moved past the student's own.
+void watchLeaderboard(DatabaseManager& db, int studentId, int topK = 10) {
+    mutex inboxMutex;
+    condition_variable inboxReady;
+    vector<ScoreChange> inbox;
+    uint64_t subscription = db.scoreFeed().subscribe([&](const vector<ScoreChange>& batch) {
+        {
+            lock_guard<mutex> lock(inboxMutex);
+            inbox.insert(inbox.end(), batch.begin(), batch.end());
+        }
+        inboxReady.notify_one();
+    });
+
+    vector<LeaderboardEntry> top = db.topStudents(topK);
+    int myScore = 0;
+    long long rank = db.studentRank(studentId, &myScore);
+    bool showTop = true, showRank = true;
+
+    cout << "\nWatching the leaderboard live. Press any key to stop.\n";
+    while (!_kbhit()) {
+        if (showTop) {
+            cout << "\n--- Live Student Leaderboard ---\n";
+            cout << "Rank\tUsername\tScore\n";
+            for (size_t i = 0; i < top.size(); ++i) {
+                cout << i + 1 << "\t" << top[i].username << "\t\t" << top[i].score << "\n";
+            }
+        }
+        if (showRank && rank > 0) {
+            cout << "Your rank is: " << rank << " (score " << myScore << ")\n";
+        }
+        showTop = showRank = false;
+
+        vector<ScoreChange> changes;
+        {
+            unique_lock<mutex> lock(inboxMutex);
+            inboxReady.wait_for(lock, chrono::milliseconds(250), [&] { return !inbox.empty(); });
+            changes.swap(inbox);
+        }
 
-};
+        bool reloadTop = false, recount = false;
+        for (const auto& change : changes) {
+            bool inTop = any_of(top.begin(), top.end(),
+                                [&](const LeaderboardEntry& entry) { return entry.id == change.studentId; });
+            if (inTop || top.size() < static_cast<size_t>(topK) || change.newScore >= top.back().score) {
+                reloadTop = true;
+            }
+            if (change.studentId == studentId ||
+                (min(change.oldScore, change.newScore) <= myScore && myScore <= max(change.oldScore, change.newScore))) {
+                recount = true;
+            }
+        }
+
+        if (reloadTop) {
+            vector<LeaderboardEntry> fresh = db.topStudents(topK);
+            showTop = fresh.size() != top.size() ||
+                      !equal(fresh.begin(), fresh.end(), top.begin(),
+                             [](const LeaderboardEntry& a, const LeaderboardEntry& b) {
+                                 return a.id == b.id && a.score == b.score;
+                             });
+            top.swap(fresh);
+        }
+        if (recount) {
+            int previousScore = myScore;
+            long long previousRank = rank;
+            rank = db.studentRank(studentId, &myScore);
+            showRank = rank != previousRank || myScore != previousScore;
+        }
+    }
+    _getch();
+    db.scoreFeed().unsubscribe(subscription);
+}
 
 // Admin menu implementation
 void Admin::displayMenu(DatabaseManager& db) {
@@ -589,12 +6096,17 @@ void Admin::displayMenu(DatabaseManager& db) {
         cout << "3. Delete a Quiz\n";
         cout << "4. Delete a Question from a Quiz\n";
         cout << "5. Add Question to Existing Quiz\n";
-        cout << "6. Logout\n";
+        cout << "6. Bulk Delete Quizzes\n";
+        cout << "7. Bulk Delete Questions\n";
+        cout << "8. Near-Duplicate Question Report\n";
+        cout << "9. Recalibrate Adaptive Quiz Questions\n";
+        cout << "10. Logout\n";
         cout << "Enter your choice: ";
 
         int choice;
         cin >> choice;
         cin.ignore(); // Clear newline
+        MemorySnapshot before = memorySnapshot();
 
         switch (choice) {
             case 1: {
@@ -642,6 +6154,10 @@ void Admin::displayMenu(DatabaseManager& db) {
                               cout << "Invalid input. Please enter a number between 1 and " << options.size() << ".\n";
                             }
                         }
+                    if (!confirmNotDuplicate(db, text, options)) {
+                        cout << "Question skipped.\n";
+                        continue;
+                    }
                     newQuiz.addQuestion(Question(0, text, options, correctOption, 0));
                 }
 
@@ -653,8 +6169,7 @@ void Admin::displayMenu(DatabaseManager& db) {
                 break;
             }
             case 2: {
-                auto quizzes = db.getAllQuizzes();
-                if (quizzes.empty()) {
+                if (db.getQuizPage(0, 1).empty()) {
                     cout << "\nNo quizzes found.\n";
                     char create;
                     cout << "Would you like to create a new quiz? (y/n): ";
@@ -706,6 +6221,10 @@ void Admin::displayMenu(DatabaseManager& db) {
                               cout << "Invalid input. Please enter a number between 1 and " << options.size() << ".\n";
                             }
                         }
+                            if (!confirmNotDuplicate(db, text, options)) {
+                                cout << "Question skipped.\n";
+                                continue;
+                            }
                             newQuiz.addQuestion(Question(0, text, options, correctOption, 0));
                         }
 
@@ -717,160 +6236,166 @@ void Admin::displayMenu(DatabaseManager& db) {
                     }
                     // If 'n' was chosen, it will naturally return to the admin menu
                 } else {
-                    cout << "\nAll Quizzes:\n";
-                    for (const auto& quiz : quizzes) {
-                        quiz.display();
-                    }
+                    browseQuizzes(db, "All Quizzes", "No quizzes found.", true);
                 }
                 break;
             }
             
             case 3: {
-    auto quizzes = db.getAllQuizzes();
-    if (quizzes.empty()) {
-        cout << "No quizzes available to delete.\n";
+    string term;
+    cout << "Search quizzes (leave blank to list all): ";
+    getline(cin, term);
+    if (!term.empty()) {
+        int quizId = chooseSearchHit(db, term, SearchIndex::QuizDoc);
+        if (quizId >= 0) {
+            cout << (db.deleteQuiz(quizId) ? "Quiz deleted successfully.\n" : "Failed to delete quiz.\n");
+        }
         break;
     }
 
-    cout << "\nSelect a quiz to delete:\n";
-    for (size_t i = 0; i < quizzes.size(); ++i) {
-        cout << i + 1 << ". " << quizzes[i].getTitle() << "\n";
-    }
-
-    int quizChoice;
-    cout << "Enter your choice (1-" << quizzes.size() << "): ";
-    cin >> quizChoice;
-
-    if (quizChoice >= 1 && quizChoice <= static_cast<int>(quizzes.size())) {
-        int quizId = quizzes[quizChoice - 1].getId();
+    int quizId = selectQuiz(db, "Select a quiz to delete", "No quizzes available to delete.");
+    if (quizId >= 0) {
         if (db.deleteQuiz(quizId)) {
             cout << "Quiz deleted successfully.\n";
         } else {
             cout << "Failed to delete quiz.\n";
         }
-    } else {
-        cout << "Invalid choice.\n";
     }
     break;
 }
 
 case 4: {
-    auto quizzes = db.getAllQuizzes();
-    if (quizzes.empty()) {
-        cout << "No quizzes available.\n";
+    string term;
+    cout << "Search questions (leave blank to pick a quiz): ";
+    getline(cin, term);
+    if (!term.empty()) {
+        int questionId = chooseSearchHit(db, term, SearchIndex::QuestionDoc);
+        if (questionId >= 0) {
+            cout << (db.deleteQuestion(questionId) ? "Question deleted successfully.\n"
+                                                   : "Failed to delete question.\n");
+        }
         break;
     }
 
-    cout << "\nSelect a quiz:\n";
-    for (size_t i = 0; i < quizzes.size(); ++i) {
-        cout << i + 1 << ". " << quizzes[i].getTitle() << "\n";
-    }
-
-    int quizChoice;
-    cout << "Enter your choice (1-" << quizzes.size() << "): ";
-    cin >> quizChoice;
+    int quizId = selectQuiz(db, "Select a quiz", "No quizzes available.");
+    if (quizId < 0) break;
 
-    if (quizChoice >= 1 && quizChoice <= static_cast<int>(quizzes.size())) {
-        const auto& selectedQuiz = quizzes[quizChoice - 1];
-        const auto& questions = selectedQuiz.getQuestions();
-        if (questions.empty()) {
-            cout << "No questions in this quiz.\n";
-            break;
-        }
-
-        cout << "\nSelect a question to delete:\n";
-        for (size_t i = 0; i < questions.size(); ++i) {
-            cout << i + 1 << ". " << questions[i].getText() << "\n";
-        }
+    int questionId = pageThrough<Question>("Select a question to delete", "No questions in this quiz.", true,
+        [&db, quizId](int afterId, int limit) { return db.getQuestionPage(quizId, afterId, limit); },
+        [](size_t number, const Question& question) { cout << number << ". " << question.getText() << "\n"; });
 
-        int qChoice;
-        cout << "Enter your choice (1-" << questions.size() << "): ";
-        cin >> qChoice;
-
-        if (qChoice >= 1 && qChoice <= static_cast<int>(questions.size())) {
-            int questionId = questions[qChoice - 1].getId();
-            if (db.deleteQuestion(questionId)) {
-                cout << "Question deleted successfully.\n";
-            } else {
-                cout << "Failed to delete question.\n";
-            }
+    if (questionId >= 0) {
+        if (db.deleteQuestion(questionId)) {
+            cout << "Question deleted successfully.\n";
         } else {
-            cout << "Invalid choice.\n";
+            cout << "Failed to delete question.\n";
         }
-    } else {
-        cout << "Invalid choice.\n";
     }
     break;
 }
 
             case 5: {  // New case for adding question to existing quiz
-                auto quizzes = db.getAllQuizzes();
-                if (quizzes.empty()) {
-                    cout << "No quizzes available to add questions to.\n";
-                    break;
-                }
-
-                cout << "\nSelect a quiz to add a question to:\n";
-                for (size_t i = 0; i < quizzes.size(); ++i) {
-                    cout << i + 1 << ". " << quizzes[i].getTitle() << "\n";
+                int quizId = -1;
+                string term;
+                cout << "Search quizzes (leave blank to list all): ";
+                getline(cin, term);
+                if (!term.empty()) {
+                    quizId = chooseSearchHit(db, term, SearchIndex::QuizDoc);
+                    if (quizId < 0) break;
+                } else {
+                    quizId = selectQuiz(db, "Select a quiz to add a question to",
+                                        "No quizzes available to add questions to.");
+                    if (quizId < 0) break;
                 }
 
-                int quizChoice;
-                cout << "Enter your choice (1-" << quizzes.size() << "): ";
-                cin >> quizChoice;
-                cin.ignore();
+                string text;
+                vector<string> options;
+                int correctOption;
 
-                if (quizChoice >= 1 && quizChoice <= static_cast<int>(quizzes.size())) {
-                    int quizId = quizzes[quizChoice - 1].getId();
-                    
-                    string text;
-                    vector<string> options;
-                    int correctOption;
+                cout << "\nEnter the question text: ";
+                getline(cin, text);
 
-                    cout << "\nEnter the question text: ";
-                    getline(cin, text);
+                for (int j = 0; j < 4; ++j) {
+                    string option;
+                    cout << "Option " << j + 1 << ": ";
+                    getline(cin, option);
+                    if (!option.empty()) {
+                        options.push_back(option);
+                    } else {
+                        break;
+                    }
+                }
 
-                    for (int j = 0; j < 4; ++j) {
-                        string option;
-                        cout << "Option " << j + 1 << ": ";
-                        getline(cin, option);
-                        if (!option.empty()) {
-                            options.push_back(option);
-                        } else {
-                            break;
+                while (true) {
+                    cout << "Correct option (1-" << options.size() << "): ";
+                    cin >> correctOption;
+                    cin.ignore();
+                    if (correctOption >= 1 && correctOption <= static_cast<int>(options.size())) {
+                        break;
+                    } else {
+                          cout << "Invalid input. Please enter a number between 1 and " << options.size() << ".\n";
                         }
                     }
 
-                    while (true) {
-                        cout << "Correct option (1-" << options.size() << "): ";
-                        cin >> correctOption;
-                        cin.ignore();
-                        if (correctOption >= 1 && correctOption <= static_cast<int>(options.size())) {
-                            break;
-                        } else {
-                              cout << "Invalid input. Please enter a number between 1 and " << options.size() << ".\n";
-                            }
-                        }
+                if (!confirmNotDuplicate(db, text, options)) {
+                    cout << "Question not added.\n";
+                    break;
+                }
 
-                    // Create a temporary question object
-                    Question newQuestion(0, text, options, correctOption, quizId);
-                    
-                    if (db.addQuestion(quizId, newQuestion)) {
-                        cout << "Question added successfully!\n";
-                    } else {
-                        cout << "Failed to add question.\n";
-                    }
+                // Create a temporary question object
+                Question newQuestion(0, text, options, correctOption, quizId);
+                
+                if (db.addQuestion(quizId, newQuestion)) {
+                    cout << "Question added successfully!\n";
                 } else {
-                    cout << "Invalid choice.\n";
+                    cout << "Failed to add question.\n";
                 }
                 break;
             }
             
             case 6:
+                bulkDeleteFlow("quiz", &DatabaseManager::deleteQuizzes,
+                               &DatabaseManager::deleteQuizzesMatching, db);
+                break;
+
+            case 7:
+                bulkDeleteFlow("question", &DatabaseManager::deleteQuestions,
+                               &DatabaseManager::deleteQuestionsMatching, db);
+                break;
+
+            case 8: {
+                auto pairs = db.nearDuplicateReport();
+                if (pairs.empty()) {
+                    cout << "\nNo near-duplicate questions found.\n";
+                    break;
+                }
+
+                cout << "\n--- Near-Duplicate Questions ---\n";
+                for (const auto& pair : pairs) {
+                    cout << static_cast<int>(pair.first.similarity * 100) << "% similar:\n"
+                         << "  #" << pair.first.id << " (quiz " << pair.first.quizId << ") " << pair.first.text << "\n"
+                         << "  #" << pair.second.id << " (quiz " << pair.second.quizId << ") " << pair.second.text << "\n";
+                }
+                cout << pairs.size() << " pair(s) found. Use Bulk Delete Questions with the IDs above to clean up.\n";
+                break;
+            }
+
+            case 9: {
+                int updated = db.recalibrateItemParameters(30);
+                if (updated >= 0) {
+                    cout << "Recalibrated " << updated << " question(s) with at least 30 answers.\n";
+                } else {
+                    cout << "Recalibration failed.\n";
+                }
+                break;
+            }
+
+            case 10:
                 return;
             default:
                 cout << "Invalid choice. Try again.\n";
         }
+        if (memoryAccounting) printMemoryDelta("Admin menu option " + to_string(choice), before);
     }
 }
 
@@ -882,71 +6407,122 @@ void Student::displayMenu(DatabaseManager& db) {
         cout << "2. View My Score\n";
         cout << "3. View My Rank\n";
         cout << "4. View Available Quizzes\n";
-        cout << "5. Logout\n";
+        cout << "5. View Leaderboards\n";
+        cout << "6. Watch Live Leaderboard\n";
+        cout << "7. Logout\n";
         cout << "Enter your choice: ";
 
         int choice;
         cin >> choice;
+        MemorySnapshot before = memorySnapshot();
 
         switch (choice) {
             case 1: {
-                auto quizzes = db.getAllQuizzes();
-                if (quizzes.empty()) {
-                    cout << "No quizzes available at the moment, please check back later!!!!.\n";
+                QuizFilter filter = askQuizFilter();
+                int quizId = selectQuiz(db, "Available Quizzes",
+                                        filter == AllQuizzes
+                                            ? "No quizzes available at the moment, please check back later!!!!."
+                                            : "No quizzes match that filter.",
+                                        &completedQuizzes, filter);
+                if (quizId < 0) break;
+
+                cout << "1. Answer every question\n";
+                cout << "2. Adaptive (fewer questions, picked for your level)\n";
+                cout << "Enter your choice: ";
+                int mode;
+                cin >> mode;
+
+                if (mode == 2) {
+                    if (!runAdaptiveQuiz(db, id, quizId)) {
+                        cout << "That quiz has no questions.\n";
+                    }
                     break;
                 }
 
-                cout << "\nAvailable Quizzes:\n";
-                for (size_t i = 0; i < quizzes.size(); ++i) {
-                    cout << i + 1 << ". " << quizzes[i].getTitle() << "\n";
+                auto quiz = db.pinQuiz(quizId);
+                if (!quiz) {
+                    cout << "That quiz is no longer available.\n";
+                    break;
                 }
 
-                cout << "Select a quiz to take (1-" << quizzes.size() << "): ";
-                int quizChoice;
-                cin >> quizChoice;
+                vector<pair<int, bool>> responses;
+                int attemptScore = quiz->startQuiz(&responses);
+                db.recordResponses(responses);
 
-                if (quizChoice > 0 && quizChoice <= static_cast<int>(quizzes.size())) {
-                    quizzes[quizChoice - 1].startQuiz(*this);
-                    db.recordQuizAttempt(id, quizzes[quizChoice - 1].getId(), score);
+                if (db.submitQuizAttempt(id, quizId, attemptScore)) {
+                    completedQuizzes.add(quizId);
                 } else {
-                    cout << "Invalid choice.\n";
+                    cout << "Failed to save your result.\n";
                 }
                 break;
             }
-            case 2:
+            case 2: {
+                score = db.getStudentScore(id);
                 cout << "\nYour total score: " << score << "\n";
+                size_t pending = db.pendingAttempts(id);
+                if (pending > 0) {
+                    cout << "(" << pending << " recent result(s) are saved and will be added shortly)\n";
+                }
                 break;
+            }
                 
             case 3:
                 db.displayStudentRanks(id);
                 break;    
-            case 4: {
-                auto quizzes = db.getAllQuizzes();
-    if (quizzes.empty()) {
-        cout << "\nNo quizzes are currently available.\n";
-    } else {
-        cout << "\nAvailable Quizzes:\n";
-        for (const auto& quiz : quizzes) {
-            quiz.display();
-        }
-    }
-    break;
+            case 4:
+                browseQuizzes(db, "Available Quizzes", "No quizzes to show.", false,
+                              &completedQuizzes, askQuizFilter());
+                break;
+            case 5: {
+                cout << "1. All time\n2. Today\n3. This week\n4. This term\n";
+                cout << "Enter your choice: ";
+                int window;
+                cin >> window;
+                const char* periods[] = {"", "day", "week", "term"};
+                const char* names[] = {"All Time", "Today", "This Week", "This Term"};
+                if (window < 1 || window > 4) {
+                    cout << "Invalid choice.\n";
+                    break;
+                }
+
+                cout << "1. All quizzes\n2. One quiz\n";
+                cout << "Enter your choice: ";
+                int scope;
+                cin >> scope;
+                int quizId = 0;
+                string heading = string("Leaderboard: ") + names[window - 1];
+                if (scope == 2) {
+                    quizId = selectQuiz(db, "Choose a Quiz", "No quizzes available.", &completedQuizzes);
+                    if (quizId < 0) break;
+                    heading += ", quiz #" + to_string(quizId);
+                }
+                db.displayLeaderboard(heading, periods[window - 1], quizId, id);
+                break;
             }
-            case 5:
+            case 6:
+                watchLeaderboard(db, id);
+                break;
+            case 7:
                 return;
             default:
                 cout << "Invalid choice. Try again.\n";
         }
+        if (memoryAccounting) printMemoryDelta("Student menu option " + to_string(choice), before);
     }
 }
 
-void deleteAccountFlow(DatabaseManager& db) {
+void deleteAccountFlow(DatabaseManager& db, LoginRateLimiter& limiter, const string& client) {
     string username, password;
     cout << "\n=== Delete Account ===\n";
     cout << "Enter your username (or 'cancel' to exit): ";
     cin >> username;
     if (username == "cancel") return;
 
+    if (!limiter.allow(username, client)) {
+        cout << "Too many attempts. Please try again later.\n";
+        return;
+    }
+
     // First check if username exists in any role
     auto userRoles = db.getUserRoles(username);
     if (userRoles.empty()) {
@@ -960,6 +6536,11 @@ void deleteAccountFlow(DatabaseManager& db) {
         password = getHiddenInput("Password: ");
         if (password == "cancel") return;
 
+        if (!limiter.allow(username, client)) {
+            cout << "Too many attempts. Please try again later.\n";
+            return;
+        }
+
         // Get roles that match both username AND password
         auto validRoles = db.getUserRoles(username, password);
         if (!validRoles.empty()) {
@@ -970,8 +6551,6 @@ void deleteAccountFlow(DatabaseManager& db) {
         cout << "Incorrect password. Try again or type 'cancel' to exit.\n";
 }
 
-    userRoles = db.getUserRoles(username, password); // Refresh roles with valid password
-
     if (userRoles.size() > 1) {
         cout << "\nYou have multiple roles:\n";
         for (size_t i = 0; i < userRoles.size(); ++i) {
@@ -987,12 +6566,7 @@ void deleteAccountFlow(DatabaseManager& db) {
         if (choice == static_cast<int>(userRoles.size() + 2)) return;
 
         if (choice == static_cast<int>(userRoles.size() + 1)) {
-            bool success = true;
-            for (const auto& ur : userRoles) {
-                if (!db.deleteUserAccount(ur.id, ur.role)) {
-                    success = false;
-                }
-            }
+            bool success = db.deleteUserAccounts(userRoles) == static_cast<int>(userRoles.size());
             cout << (success ? "All roles deleted.\n" : "Error deleting roles.\n");
         } else if (choice > 0 && choice <= static_cast<int>(userRoles.size())) {
             const auto& roleToDelete = userRoles[choice - 1].role;
@@ -1020,16 +6594,468 @@ void deleteAccountFlow(DatabaseManager& db) {
 }
 
 
+// Trace replay, run with --replay <file>
+
+// Latency in milliseconds at percentile p (0-100) of a sorted sample
+double percentileMillis(const vector<uint64_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t index = static_cast<size_t>(p / 100 * (sorted.size() - 1) + 0.5);
+    return sorted[index] / 1000.0;
+}
+
+// Statements that leave the database as it was: SELECT, SHOW, DESCRIBE
+// and EXPLAIN. Locking reads count, since a replayed one commits at once.
+bool isReadStatement(const string& sql) {
+    size_t start = sql.find_first_not_of(" \t\r\n(");
+    if (start == string::npos) return false;
+    size_t end = start;
+    while (end < sql.size() && isalpha(static_cast<unsigned char>(sql[end]))) ++end;
+    string keyword = sql.substr(start, end - start);
+    transform(keyword.begin(), keyword.end(), keyword.begin(), [](unsigned char c) { return toupper(c); });
+    return keyword == "SELECT" || keyword == "SHOW" || keyword == "DESCRIBE" || keyword == "EXPLAIN";
+}
+
+// Re-issues recorded statements against database on target, which the
+// caller must name explicitly since writes are replayed too; with readOnly
+// only read statements are. Each traced session is replayed in order on its
+// own connection, copies times over (each copy on yet another connection),
+// with the original gaps between statements divided by speed; a speed of 0
+// replays back to back. Prints latency percentiles per operation next to
+// the ones recorded in the trace.
+bool replayTrace(const DatabaseConfig& config, const DbEndpoint& target, const string& database, bool readOnly,
+                 const vector<string>& files, double speed, int copies) {
+    vector<TraceRecord> records;
+    for (const auto& file : files) {
+        if (!readTrace(file, records)) return false;
+    }
+    if (readOnly) {
+        records.erase(remove_if(records.begin(), records.end(),
+                                [](const TraceRecord& record) { return !isReadStatement(record.sql); }),
+                      records.end());
+    }
+    if (records.empty()) {
+        cerr << "No statements to replay." << endl;
+        return false;
+    }
+    stable_sort(records.begin(), records.end(), [](const TraceRecord& a, const TraceRecord& b) {
+        return a.startedAt < b.startedAt;
+    });
+
+    map<uint64_t, vector<const TraceRecord*>> sessions;
+    for (const auto& record : records) {
+        sessions[record.session].push_back(&record);
+    }
+
+    struct Sample {
+        const TraceRecord* record;
+        uint64_t micros;
+        bool failed;
+    };
+    vector<vector<Sample>> samples(sessions.size() * copies);
+
+    uint64_t traceStart = records.front().startedAt;
+    auto replayStart = chrono::steady_clock::now();
+    vector<thread> workers;
+    size_t worker = 0;
+    for (const auto& session : sessions) {
+        for (int copy = 0; copy < copies; ++copy, ++worker) {
+            workers.emplace_back([&, worker](const vector<const TraceRecord*>& statements) {
+                mysql_thread_init();
+                vector<Sample>& out = samples[worker];
+                MYSQL* handle = mysql_init(nullptr);
+                if (handle && !mysql_real_connect(handle, target.host.c_str(), config.user.c_str(),
+                                                  config.password.c_str(), database.c_str(),
+                                                  target.port, nullptr, 0)) {
+                    cerr << "Replay Connection Error: " << mysql_error(handle) << endl;
+                    mysql_close(handle);
+                    handle = nullptr;
+                }
+
+                for (const TraceRecord* record : statements) {
+                    if (!handle) {
+                        out.push_back({record, 0, true});
+                        continue;
+                    }
+                    if (speed > 0) {
+                        this_thread::sleep_until(replayStart + chrono::microseconds(
+                            static_cast<long long>((record->startedAt - traceStart) / speed)));
+                    }
+
+                    auto start = chrono::steady_clock::now();
+                    bool failed = mysql_real_query(handle, record->sql.data(), record->sql.size()) != 0;
+                    if (!failed) {
+                        MYSQL_RES* result = mysql_store_result(handle);
+                        if (result) freeResult(result);
+                    }
+                    uint64_t micros = chrono::duration_cast<chrono::microseconds>(
+                        chrono::steady_clock::now() - start).count();
+                    out.push_back({record, micros, failed});
+                }
+
+                if (handle) mysql_close(handle);
+                mysql_thread_end();
+            }, cref(session.second));
+        }
+    }
+    for (auto& replayer : workers) {
+        replayer.join();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - replayStart).count();
+
+    struct Latencies {
+        vector<uint64_t> replayed;
+        vector<uint64_t> recorded;
+        size_t errors;
+    };
+    map<string, Latencies> byOperation;
+    Latencies& all = byOperation["(all)"];
+    for (const auto& perWorker : samples) {
+        for (const auto& sample : perWorker) {
+            for (Latencies* bucket : {&all, &byOperation[sample.record->operation]}) {
+                bucket->replayed.push_back(sample.micros);
+                bucket->recorded.push_back(sample.record->durationMicros);
+                if (sample.failed) ++bucket->errors;
+            }
+        }
+    }
+
+    cout << "Replayed " << all.replayed.size() << " statements from " << sessions.size()
+         << " session(s) x " << copies << " in " << seconds << " s ("
+         << all.replayed.size() / seconds << " statements/s)\n";
+    cout << "Latency in ms, replayed (recorded):\n";
+    for (auto& entry : byOperation) {
+        Latencies& latencies = entry.second;
+        sort(latencies.replayed.begin(), latencies.replayed.end());
+        sort(latencies.recorded.begin(), latencies.recorded.end());
+        cout << "  " << entry.first << ": " << latencies.replayed.size() << " statements, "
+             << latencies.errors << " errors";
+        for (double p : {50.0, 90.0, 99.0}) {
+            cout << ", p" << p << " " << percentileMillis(latencies.replayed, p)
+                 << " (" << percentileMillis(latencies.recorded, p) << ")";
+        }
+        cout << ", max " << latencies.replayed.back() / 1000.0
+             << " (" << latencies.recorded.back() / 1000.0 << ")\n";
+    }
+    return true;
+}
+
+
+// Benchmarks, run with --benchmark <name>
+
+// Compares query throughput of the blocking API against the async API with
+// many queries in flight
+void benchmarkAsyncQueries(DatabaseManager& db, int queries) {
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < queries; ++i) {
+        db.getStudentScore(1);
+    }
+    double blockingSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    db.startAsync(2, 8);
+    start = chrono::steady_clock::now();
+    vector<future<int>> pending;
+    pending.reserve(queries);
+    for (int i = 0; i < queries; ++i) {
+        pending.push_back(db.getStudentScoreAsync(1));
+    }
+    for (auto& result : pending) {
+        result.get();
+    }
+    double asyncSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "Blocking: " << queries / blockingSeconds << " queries/s\n";
+    cout << "Async (2 threads x 8 connections): " << queries / asyncSeconds << " queries/s\n";
+}
+
+// Logins per second (one scrypt verification each) at several cost
+// settings, using every hashing thread
+void benchmarkPasswordHashing(size_t threads) {
+    for (int costLog2 = 10; costLog2 <= 16; costLog2 += 2) {
+        ScryptParams params = {costLog2, 8, 1};
+        string stored = PasswordHasher::hashNow("benchmark", params);
+        PasswordHasher hasher(params, threads, threads * 4);
+
+        size_t logins = threads * 8;
+        auto start = chrono::steady_clock::now();
+        vector<future<bool>> pending;
+        for (size_t i = 0; i < logins; ++i) {
+            pending.push_back(hasher.verify("benchmark", stored));
+        }
+        for (auto& result : pending) {
+            result.get();
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        cout << "ln=" << costLog2 << " (" << (128 * 8 << costLog2) / (1024 * 1024) << " MiB): "
+             << logins / seconds << " logins/s, " << logins / seconds / threads << " per core\n";
+    }
+}
+
+// Rate limiter checks per second with many threads hammering one username
+// (a brute-force run) and with each thread on its own username. The limits
+// are set so nearly every check is allowed and therefore writes its shard.
+void benchmarkRateLimiter(int checksPerThread) {
+    unsigned int maxThreads = max(2u, 2 * thread::hardware_concurrency());
+    for (unsigned int threads = 1; threads <= maxThreads; threads *= 2) {
+        for (int shared = 1; shared >= 0; --shared) {
+            LoginRateLimiter limiter({1, 0}, {1, 0});
+
+            auto start = chrono::steady_clock::now();
+            vector<thread> workers;
+            for (unsigned int t = 0; t < threads; ++t) {
+                workers.emplace_back([&, t] {
+                    string username = shared ? "admin" : "user" + to_string(t);
+                    string client = shared ? "attacker" : "client" + to_string(t);
+                    for (int i = 0; i < checksPerThread; ++i) {
+                        limiter.allow(username, client);
+                    }
+                });
+            }
+            for (auto& worker : workers) {
+                worker.join();
+            }
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            double checks = double(threads) * checksPerThread;
+
+            cout << threads << " thread(s), " << (shared ? "same user:     " : "distinct users:")
+                 << " " << checks / seconds / 1e6 << "M checks/s, "
+                 << seconds * threads * 1e9 / checks << " ns/check\n";
+        }
+    }
+}
+
+// Item selection time over a synthetic bank, against a linear scan, and
+// how many questions simulated students need before the estimate settles
+void benchmarkAdaptiveSelection(size_t items, int students) {
+    mt19937 random(42);
+    normal_distribution<double> normal(0, 1);
+    uniform_real_distribution<double> discrimination(0.5, 2.0);
+    const double guessRates[] = {0.5, 1.0 / 3, 0.25};
+
+    ItemBank bank;
+    for (size_t item = 0; item < items; ++item) {
+        bank.add(static_cast<int>(item + 1), discrimination(random), 1.2 * normal(random), guessRates[item % 3]);
+    }
+    bank.finalize();
+
+    double selectSeconds = 0, scanSeconds = 0, squaredError = 0;
+    size_t selections = 0, asked = 0;
+    uniform_real_distribution<double> uniform(0, 1);
+    for (int student = 0; student < students; ++student) {
+        double trueTheta = normal(random);
+        AbilityEstimate ability;
+        vector<char> used(bank.size(), 0);
+        size_t questions = 0;
+
+        while (!ability.settled(questions)) {
+            auto start = chrono::steady_clock::now();
+            long item = bank.nextItem(ability.theta(), used);
+            selectSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            ++selections;
+            if (item < 0) break;
+
+            start = chrono::steady_clock::now();
+            long scanned = -1;
+            double bestInformation = -1;
+            for (size_t candidate = 0; candidate < bank.size(); ++candidate) {
+                double information = used[candidate] ? -1 : bank.information(candidate, ability.theta());
+                if (information > bestInformation) {
+                    bestInformation = information;
+                    scanned = static_cast<long>(candidate);
+                }
+            }
+            scanSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            if (scanned != item && bank.information(scanned, ability.theta()) > bank.information(item, ability.theta())) {
+                cerr << "Selection mismatch at item " << item << " vs " << scanned << endl;
+            }
+
+            used[item] = 1;
+            ability.update(bank, item, uniform(random) < bank.probability(item, trueTheta));
+            ++questions;
+        }
+        asked += questions;
+        squaredError += (ability.theta() - trueTheta) * (ability.theta() - trueTheta);
+    }
+
+    cout << items << " items: " << selectSeconds * 1e6 / selections << " us per selection, linear scan "
+         << scanSeconds * 1e6 / selections << " us\n";
+    cout << double(asked) / students << " questions per student on average, ability RMSE "
+         << sqrt(squaredError / students) << "\n";
+}
+
+// Quiz lookups per second across thread counts while a writer publishes an
+// edited quiz every millisecond, for the snapshot catalog and for a map
+// behind one mutex
+void benchmarkCatalogReads(int readsPerThread) {
+    const int quizCount = 1000;
+    CatalogStore store;
+    map<int, shared_ptr<const Quiz>> locked;
+    mutex lockedMutex;
+
+    store.update([&](CatalogSnapshot& snapshot) {
+        for (int quizId = 1; quizId <= quizCount; ++quizId) {
+            shared_ptr<Quiz> quiz(new Quiz(quizId, "Quiz " + to_string(quizId), ""));
+            for (int i = 0; i < 10; ++i) {
+                quiz->addQuestion(Question(quizId * 10 + i, "Question", {"a", "b", "c", "d"}, 1, quizId));
+            }
+            snapshot.quizzes[quizId] = quiz;
+            locked[quizId] = quiz;
+        }
+    });
+
+    unsigned int maxThreads = max(2u, 2 * thread::hardware_concurrency());
+    for (unsigned int threads = 1; threads <= maxThreads; threads *= 2) {
+        for (int useSnapshots = 1; useSnapshots >= 0; --useSnapshots) {
+            atomic<bool> reading{true};
+            thread writer([&] {
+                for (int edit = 0; reading; ++edit) {
+                    int quizId = edit % quizCount + 1;
+                    shared_ptr<const Quiz> edited = store.pin(quizId);
+                    if (useSnapshots) {
+                        store.update([&](CatalogSnapshot& snapshot) { snapshot.quizzes[quizId] = edited; });
+                    } else {
+                        lock_guard<mutex> lock(lockedMutex);
+                        locked[quizId] = edited;
+                    }
+                    this_thread::sleep_for(chrono::milliseconds(1));
+                }
+            });
+
+            auto start = chrono::steady_clock::now();
+            vector<thread> readers;
+            for (unsigned int t = 0; t < threads; ++t) {
+                readers.emplace_back([&, t] {
+                    size_t questions = 0;
+                    for (int i = 0; i < readsPerThread; ++i) {
+                        int quizId = static_cast<int>((t * 7919 + i) % quizCount) + 1;
+                        shared_ptr<const Quiz> quiz;
+                        if (useSnapshots) {
+                            quiz = store.pin(quizId);
+                        } else {
+                            lock_guard<mutex> lock(lockedMutex);
+                            quiz = locked[quizId];
+                        }
+                        questions += quiz->getQuestions().size();
+                    }
+                    if (questions == 0) cerr << "Catalog benchmark found no questions" << endl;
+                });
+            }
+            for (auto& reader : readers) {
+                reader.join();
+            }
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            reading = false;
+            writer.join();
+
+            double reads = double(threads) * readsPerThread;
+            cout << threads << " thread(s), " << (useSnapshots ? "snapshots:" : "mutex:    ")
+                 << " " << reads / seconds / 1e6 << "M lookups/s, "
+                 << seconds * threads * 1e9 / reads << " ns/lookup\n";
+        }
+    }
+}
+
+// Rows decoded per second from synthetic leaderboard rows (id, username,
+// score), by hand with stoi and by RowReader
+void benchmarkRowDecoding(int rowCount) {
+    vector<string> text;
+    for (int i = 0; i < rowCount; ++i) {
+        text.push_back(to_string(i * 7 + 1));
+        text.push_back("student" + to_string(i));
+        text.push_back(to_string(i % 1000));
+    }
+    vector<char*> cells;
+    vector<unsigned long> lengths;
+    for (auto& cell : text) {
+        cells.push_back(&cell[0]);
+        lengths.push_back(cell.size());
+    }
+
+    struct Entry {
+        int id;
+        string username;
+        int score;
+    };
+    for (int typed = 0; typed <= 1; ++typed) {
+        long long checksum = 0;
+        Entry entry;
+        auto start = chrono::steady_clock::now();
+        for (int pass = 0; pass < 10; ++pass) {
+            for (int i = 0; i < rowCount; ++i) {
+                MYSQL_ROW row = &cells[i * 3];
+                if (typed) {
+                    RowReader<int, string, int>::decode(row, &lengths[i * 3], entry.id, entry.username, entry.score);
+                } else {
+                    entry = {stoi(row[0]), row[1] ? row[1] : "", row[2] ? stoi(row[2]) : 0};
+                }
+                checksum += entry.id + entry.score + entry.username.size();
+            }
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << (typed ? "RowReader:   " : "stoi/string:") << " " << rowCount * 10 / seconds / 1e6
+             << "M rows/s (checksum " << checksum << ")\n";
+    }
+}
+
+// Publishes score changes for 1,000 students from 4 threads while 1 to 500
+// spectators are subscribed, and reports how many batches each spectator
+// got and how far coalescing shrank them
+void benchmarkScoreFeed(int changesPerThread) {
+    for (int spectators : {1, 100, 500}) {
+        ScoreFeed feed;
+        atomic<long long> batches(0), delivered(0);
+        vector<uint64_t> subscriptions;
+        for (int i = 0; i < spectators; ++i) {
+            subscriptions.push_back(feed.subscribe([&](const vector<ScoreChange>& batch) {
+                batches.fetch_add(1, memory_order_relaxed);
+                delivered.fetch_add(batch.size(), memory_order_relaxed);
+            }));
+        }
+
+        auto start = chrono::steady_clock::now();
+        vector<thread> publishers;
+        for (int t = 0; t < 4; ++t) {
+            publishers.emplace_back([&feed, changesPerThread, t] {
+                mt19937 random(t);
+                for (int i = 0; i < changesPerThread; ++i) {
+                    int score = static_cast<int>(random() % 100);
+                    feed.publish({static_cast<int>(random() % 1000) + 1, score, score + 1});
+                }
+            });
+        }
+        for (auto& publisher : publishers) {
+            publisher.join();
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        this_thread::sleep_for(chrono::milliseconds(600));
+        for (uint64_t subscription : subscriptions) {
+            feed.unsubscribe(subscription);
+        }
+
+        long long perSpectator = batches.load() / spectators;
+        cout << spectators << " spectator(s): " << 4 * changesPerThread / seconds / 1e6 << "M changes/s published, "
+             << perSpectator << " batch(es) each, "
+             << (perSpectator ? delivered.load() / batches.load() : 0) << " changes per batch\n";
+    }
+}
+
 // Main application
 // Main application class to run the quiz system
 class QuizApplication {
 private:
     DatabaseManager db;
+    LoginRateLimiter loginLimiter;
+    string clientId;
 
 public:
-    QuizApplication(const string& server, const string& user,
-                   const string& password, const string& database)
-        : db(server, user, password, database) {}
+    QuizApplication(const DatabaseConfig& config)
+        // 5 tries per username, then one every 30 s; 20 per client, then one every 3 s
+        : db(config), loginLimiter({5, 30 * 1000000ULL}, {20, 3 * 1000000ULL}) {
+        // The console has no remote address; attempts are counted per machine
+        const char* host = getenv("COMPUTERNAME");
+        if (!host) host = getenv("HOSTNAME");
+        clientId = host ? host : "local";
+    }
 
     void run() {
     while (true) {
@@ -1047,21 +7073,21 @@ public:
         switch (choice) {
 
     case 1: {
+    MemoryTagScope session(TagSessions);
     string username, password;
     cout << "Username: ";
     getline(cin, username);
     password = getHiddenInput("Password: ");
 
-    // Step 1: Verify password first
-    if (!db.verifyPassword(username, password)) {
-        cout << "\nInvalid username or password.\n";
+    if (!loginLimiter.allow(username, clientId)) {
+        cout << "\nToo many login attempts. Please try again later.\n";
         break;
     }
 
-    // Step 2: Get all available roles
-    auto allRoles = db.getAllRolesForUser(username);
+    // Only the roles whose password matches are offered
+    auto allRoles = db.getUserRoles(username, password);
     if (allRoles.empty()) {
-        cout << "\nNo roles found for this user.\n";
+        cout << "\nInvalid username or password.\n";
         break;
     }
 
@@ -1071,7 +7097,10 @@ public:
         if (allRoles[0].role == "admin") {
             user = make_unique<Admin>(allRoles[0].id, username, password);
         } else {
-            user = make_unique<Student>(allRoles[0].id, username, password);
+            auto student = make_unique<Student>(allRoles[0].id, username, password);
+            student->updateScore(db.getStudentScore(allRoles[0].id));
+            student->setCompletedQuizzes(db.getCompletedQuizzes(allRoles[0].id));
+            user = std::move(student);
         }
     } else {
         // Multiple roles - show selection
@@ -1095,7 +7124,10 @@ public:
         if (allRoles[choice-1].role == "admin") {
             user = make_unique<Admin>(allRoles[choice-1].id, username, password);
         } else {
-            user = make_unique<Student>(allRoles[choice-1].id, username, password);
+            auto student = make_unique<Student>(allRoles[choice-1].id, username, password);
+            student->updateScore(db.getStudentScore(allRoles[choice-1].id));
+            student->setCompletedQuizzes(db.getCompletedQuizzes(allRoles[choice-1].id));
+            user = std::move(student);
         }
     }
 
@@ -1106,6 +7138,7 @@ public:
 }
 
     case 2: {
+    MemoryTagScope session(TagSessions);
     string username, password, confirmPassword, role;
     cout << "Username: ";
     getline(cin, username);
@@ -1160,7 +7193,7 @@ public:
             }
 
             case 4 :
-                deleteAccountFlow(db);
+                deleteAccountFlow(db, loginLimiter, clientId);
                 break;
             default:
                 cout << "Invalid choice. Try again.\n";
@@ -1169,15 +7202,147 @@ public:
 }
 };
 
-int main() {
+int main(int argc, char* argv[]) {
     // Initialize MySQL connection parameters
-    string server = "localhost";
-    string user = "quiz_user";
-    string password = "quiz_password";
-    string database = "quiz_system";
+    DatabaseConfig config;
+    config.primary = {"localhost", 0};
+    config.user = "quiz_user";
+    config.password = "quiz_password";
+    config.database = "quiz_system";
+    config.readYourWritesSeconds = 5;
+    config.passwordHashing = {14, 8, 1};
+    config.hashingThreads = max(1u, thread::hardware_concurrency());
+    config.journalPath = "linquiz_attempts.journal";
+
+    bool reconcileScores = false;
+    bool pruneLogs = false;
+    string rosterPath;
+    string benchmark;
+    vector<string> replayFiles;
+    double replaySpeed = 1;
+    int replayCopies = 1;
+    DbEndpoint replayTarget;
+    string replayDatabase;
+    bool replayReadOnly = false;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--reconcile-scores") {
+            reconcileScores = true;
+        } else if (arg == "--prune-change-logs") {
+            pruneLogs = true;
+        } else if (arg == "--import-roster" && i + 1 < argc) {
+            rosterPath = argv[++i];
+        } else if (arg == "--benchmark" && i + 1 < argc) {
+            benchmark = argv[++i];
+        } else if (arg == "--trace" && i + 1 < argc) {
+            config.tracePath = argv[++i];
+        } else if (arg == "--replay" && i + 1 < argc) {
+            replayFiles.push_back(argv[++i]);
+        } else if (arg == "--replay-speed" && i + 1 < argc) {
+            replaySpeed = atof(argv[++i]);
+        } else if (arg == "--replay-concurrency" && i + 1 < argc) {
+            replayCopies = max(1, atoi(argv[++i]));
+        } else if (arg == "--replay-target" && i + 1 < argc) {
+            string target = argv[++i];
+            size_t slash = target.rfind('/');
+            if (slash == string::npos || slash == 0 || slash + 1 == target.size()) {
+                cerr << "--replay-target takes host[:port]/database" << endl;
+                return 1;
+            }
+            replayTarget = parseEndpoint(target.substr(0, slash));
+            replayDatabase = target.substr(slash + 1);
+        } else if (arg == "--read-only") {
+            replayReadOnly = true;
+        } else if (arg == "--journal" && i + 1 < argc) {
+            config.journalPath = argv[++i];
+        } else if (arg == "--no-journal") {
+            config.journalPath.clear();
+        } else if (arg == "--scrypt-cost" && i + 1 < argc) {
+            config.passwordHashing.costLog2 = atoi(argv[++i]);
+            if (!PasswordHasher::validParams(config.passwordHashing)) {
+                cerr << "--scrypt-cost must be from 1 to 20 (at most 1 GiB per hash); "
+                     << "hashes made with other values could not be verified" << endl;
+                return 1;
+            }
+        } else if (arg == "--primary" && i + 1 < argc) {
+            config.primary = parseEndpoint(argv[++i]);
+        } else if (arg == "--replica" && i + 1 < argc) {
+            config.replicas.push_back(parseEndpoint(argv[++i]));
+        } else if (arg == "--shard" && i + 1 < argc) {
+            config.shards.push_back(parseEndpoint(argv[++i]));
+        } else if (arg == "--memory-stats") {
+            memoryAccounting = true;
+        } else {
+            cerr << "Unknown option: " << arg << endl;
+            return 1;
+        }
+    }
+
+    // Replays only talk to the target server; the schema must already be there
+    if (!replayFiles.empty()) {
+        if (replayDatabase.empty()) {
+            cerr << "--replay needs --replay-target host[:port]/database; replayed writes change that database." << endl;
+            return 1;
+        }
+        return replayTrace(config, replayTarget, replayDatabase, replayReadOnly, replayFiles, replaySpeed,
+                           replayCopies) ? 0 : 1;
+    }
+
+    // Offline job: rebuild every student's total from student_quizzes
+    if (reconcileScores) {
+        DatabaseManager db(config);
+        bool reconciled = db.reconcileStudentScores();
+        if (memoryAccounting) printMemoryReport();
+        return reconciled ? 0 : 1;
+    }
+
+    // Offline job: drop change log rows no process still needs
+    if (pruneLogs) {
+        DatabaseManager db(config);
+        bool pruned = db.pruneChangeLogs();
+        if (memoryAccounting) printMemoryReport();
+        return pruned ? 0 : 1;
+    }
+
+    // Offline job: create the accounts listed in a roster file
+    if (!rosterPath.empty()) {
+        DatabaseManager db(config);
+        bool imported = db.importRoster(rosterPath);
+        if (memoryAccounting) printMemoryReport();
+        return imported ? 0 : 1;
+    }
+
+    if (!benchmark.empty()) {
+        MemorySnapshot before = memorySnapshot();
+        if (benchmark == "async") {
+            DatabaseManager db(config);
+            benchmarkAsyncQueries(db, 10000);
+        } else if (benchmark == "hashing") {
+            benchmarkPasswordHashing(config.hashingThreads);
+        } else if (benchmark == "ratelimit") {
+            benchmarkRateLimiter(1000000);
+        } else if (benchmark == "adaptive") {
+            benchmarkAdaptiveSelection(100000, 200);
+        } else if (benchmark == "catalog") {
+            benchmarkCatalogReads(1000000);
+        } else if (benchmark == "rows") {
+            benchmarkRowDecoding(100000);
+        } else if (benchmark == "feed") {
+            benchmarkScoreFeed(250000);
+        } else {
+            cerr << "Unknown benchmark: " << benchmark << endl;
+            return 1;
+        }
+        if (memoryAccounting) {
+            printMemoryDelta("Benchmark " + benchmark, before);
+            printMemoryReport();
+        }
+        return 0;
+    }
 
-    QuizApplication app(server, user, password, database);
+    QuizApplication app(config);
     app.run();
+    if (memoryAccounting) printMemoryReport();
     return 0;
 }
 